@@ -0,0 +1,298 @@
+/*
+ * async-loop-bench.cpp
+ * Copyright 2020 - Juan C. Bryksa (jcbryksa@gmail.com)
+ *
+ * Benchmark de AsynchLoop en el host, con el timer del tick simulado
+ * (Timer2 por defecto, o Timer1 con tick fijo o en modo absoluto):
+ *
+ *   pio run -e bench && .pio/build/bench/program [ticks] [semilla] [atraso %] [ocupacion]
+ *
+ * Cada tick invoca el vector del timer y luego dispatch() (como loop()),
+ * y entre ticks genera rafagas aleatorias de altas y bajas. Las altas se
+ * regulan con la ocupacion medida: por debajo de la ocupacion objetivo
+ * (por defecto 3/4 de MAX_ASYNC_LOOPS) se agregan loops y por encima se
+ * eliminan, para medir el scheduler cerca de su capacidad y no el rechazo
+ * de altas. Los callbacks a su vez se eliminan a si mismos
+ * o agregan timeouts desde el ISR. Cada ejecucion se compara con el
+ * vencimiento esperado (ejecuciones tempranas, tardias, perdidas o
+ * posteriores a la baja) y se informa el rendimiento en ticks por segundo
+ * y el peor tiempo de un tick. Retorna 1 si hubo alguna violacion.
+ *
+ * Con ASYNC_LOOP_ABSOLUTE el porcentaje de atraso indica la probabilidad de
+ * que un tick se atienda varios periodos tarde (interrupciones bloqueadas).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+
+#include <Arduino.h>
+#include "async-loop.hpp"
+
+#if ASYNC_LOOP_TIMER == 0
+#error "el benchmark simula el Timer2 o el Timer1 (el Timer0 no genera un tick por ms)"
+#endif
+
+#if ASYNC_LOOP_TICKLESS
+#error "el benchmark invoca el vector en cada tick"
+#endif
+
+#if ASYNC_LOOP_TIMER == 2
+#define TICK_VECTOR TIMER2_COMPA_vect
+#elif ASYNC_LOOP_ABSOLUTE
+#define TICK_VECTOR TIMER1_COMPA_vect
+#else
+#define TICK_VECTOR TIMER1_OVF_vect
+#endif
+
+extern "C" void TICK_VECTOR(void);
+
+#define MAX_RECORDS  1024          // registros de loops (se reutilizan en forma circular)
+#define MAX_PERIOD   50            // ms
+#define UNSCHEDULED  0xFFFFFFFFUL  // alta desde loop() aun no aplicada por el ISR
+
+typedef struct {
+  AsynchLoop::LoopId id;
+  AsynchLoop::LoopType loopType;
+  AsynchLoop::Priority priority;
+  uint8_t active;                  // 0 luego de la baja o de la ejecucion de un ONE_TIME
+  unsigned long period;
+  unsigned long expected;          // proximo vencimiento (tick virtual)
+} Record;
+
+static Record records[MAX_RECORDS];
+static uint16_t nextRecord = 0;
+
+static unsigned long now = 0;      // tick virtual del ultimo ISR
+static unsigned long previous = 0; // tick virtual del ISR anterior
+static uint8_t inIsr = 0;
+static uint8_t occupied = 0;       // loops activos medidos (regulan las altas)
+static uint8_t target = MAX_ASYNC_LOOPS * 3 / 4;
+
+static unsigned long fires = 0, attaches = 0, rejected = 0, detaches = 0;
+static unsigned long early = 0, late = 0, lost = 0, afterDetach = 0;
+static unsigned long tickFires = 0;
+
+static uint32_t seed = 1;
+
+// xorshift32: la misma secuencia en cualquier plataforma
+static uint32_t random32() {
+  seed ^= seed << 13;
+  seed ^= seed >> 17;
+  seed ^= seed << 5;
+  return seed;
+}
+
+static uint32_t randomBelow(uint32_t n) {
+  return random32() % n;
+}
+
+
+static void fire(void *context);
+
+
+static void attachRandom() {
+
+  Record &record = records[nextRecord];
+
+  // No reutiliza un registro que sigue activo
+  if ( record.active )
+    return;
+
+  record.loopType = randomBelow(4) ? AsynchLoop::CYCLIC : AsynchLoop::ONE_TIME;
+  record.priority = (AsynchLoop::Priority) randomBelow(3);
+  record.period = 1 + randomBelow(MAX_PERIOD);
+
+  AsynchLoop::LoopId id = AsyncLoop.attach(fire, (void *) (uintptr_t) nextRecord, record.period,
+                                           record.loopType, record.priority);
+
+  if ( id == INVALID_LOOP ) {
+    rejected++;
+    return;
+  }
+
+  attaches++;
+  occupied++;
+  record.id = id;
+  record.active = 1;
+
+  // Desde el ISR vence a partir del tick actual; desde loop() se aplica en el siguiente
+  record.expected = inIsr ? now + record.period : UNSCHEDULED;
+
+  nextRecord = (nextRecord + 1) % MAX_RECORDS;
+}
+
+
+static void detachRecord(uint16_t index) {
+  AsyncLoop.detach(records[index].id);
+  records[index].active = 0;
+  occupied--;
+  detaches++;
+}
+
+
+static void fire(void *context) {
+
+  uint16_t index = (uintptr_t) context;
+  Record &record = records[index];
+
+  fires++;
+  tickFires++;
+
+  if ( ! record.active ) {
+    afterDetach++;
+    return;
+  }
+
+  // Debe ejecutarse en el primer tick que alcanza su vencimiento
+  if ( record.expected == UNSCHEDULED || record.expected > now )
+    early++;
+  else if ( record.expected <= previous )
+    late++;
+
+  if ( record.loopType == AsynchLoop::ONE_TIME ) {
+    record.active = 0;
+    occupied--;
+  }
+  else {
+#if ASYNC_LOOP_ABSOLUTE && ! ASYNC_LOOP_CATCH_UP
+    record.expected += record.period * (1 + (now - record.expected) / record.period);
+#else
+    record.expected += record.period;
+#endif
+  }
+
+  // Rafagas generadas desde los propios callbacks
+  uint32_t action = randomBelow(16);
+
+  if ( action == 0 )
+    detachRecord(index);
+  else if ( action == 1 && record.priority != AsynchLoop::LOW_PRIORITY && occupied < target )
+    attachRandom();
+
+}
+
+
+/*
+ * Avanza el Timer1 simulado `elapsed` ticks (el vector se invoca a continuacion)
+ */
+static void advance(unsigned long elapsed) {
+
+  previous = now;
+  now += elapsed;
+
+  // Las altas desde loop() vencen a partir del tick que las aplica
+  for ( int i = 0 ; i < MAX_RECORDS ; i++ )
+    if ( records[i].active && records[i].expected == UNSCHEDULED )
+      records[i].expected = now + records[i].period - 1;
+
+#if ASYNC_LOOP_ABSOLUTE
+  TCNT1 = OCR1A + (elapsed - 1) * TICK_COUNTS + randomBelow(TICK_COUNTS - 2);
+#endif
+}
+
+
+int main(int argc, char *argv[]) {
+
+  unsigned long ticks = (argc > 1) ? strtoul(argv[1], NULL, 10) : 1000000UL;
+  seed = (argc > 2) ? strtoul(argv[2], NULL, 10) : 1;
+  uint32_t latePercent = (argc > 3) ? strtoul(argv[3], NULL, 10) : 0;
+  if ( argc > 4 )
+    target = strtoul(argv[4], NULL, 10);
+
+  if ( ! seed )
+    seed = 1;
+
+  unsigned long occupancy = 0;
+  unsigned long worstFires = 0;
+  long long worstNanos = 0;
+  long long totalNanos = 0;
+
+  // El primer alta inicializa el scheduler
+  attachRandom();
+
+  for ( unsigned long t = 0 ; t < ticks ; t++ ) {
+
+    unsigned long elapsed = 1;
+#if ASYNC_LOOP_ABSOLUTE
+    if ( randomBelow(100) < latePercent )
+      elapsed += 1 + randomBelow(8);
+#else
+    (void) latePercent;
+#endif
+
+    tickFires = 0;
+    advance(elapsed);
+
+    // Se mide solo el trabajo del scheduler: el ISR y el dispatch() siguiente
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    inIsr = 1;
+    TICK_VECTOR();
+    inIsr = 0;
+    AsyncLoop.dispatch();
+    long long nanos = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+
+    totalNanos += nanos;
+    if ( nanos > worstNanos )
+      worstNanos = nanos;
+    if ( tickFires > worstFires )
+      worstFires = tickFires;
+
+    // Todo lo vencido hasta este tick ya debio ejecutarse
+    uint8_t active = 0;
+    for ( int i = 0 ; i < MAX_RECORDS ; i++ ) {
+      if ( ! records[i].active )
+        continue;
+      active++;
+      if ( records[i].expected != UNSCHEDULED && records[i].expected <= now ) {
+        lost++;
+        detachRecord(i);
+        records[i].active = 0;
+      }
+    }
+    occupancy += active;
+
+    // Rafaga de altas y bajas desde loop(), reguladas por la ocupacion
+    // medida (incluye las altas y bajas aun encoladas)
+    occupied = AsyncLoop.active();
+    uint32_t burst = randomBelow(8);
+    for ( uint32_t i = 0 ; i < burst ; i++ ) {
+      if ( occupied < target && randomBelow(3) ) {
+        attachRandom();
+      }
+      else if ( occupied >= target ) {
+        uint16_t index = randomBelow(MAX_RECORDS);
+        while ( ! records[index].active )
+          index = (index + 1) % MAX_RECORDS;
+        detachRecord(index);
+      }
+      else {
+        uint16_t index = randomBelow(MAX_RECORDS);
+        if ( records[index].active )
+          detachRecord(index);
+      }
+    }
+  }
+
+  double seconds = totalNanos / 1e9;
+
+  printf("ticks:               %lu\n", ticks);
+  printf("virtual ms:          %lu\n", now);
+  printf("ticks/s:             %.0f\n", ticks / seconds);
+  printf("mean ns/tick:        %.1f\n", seconds * 1e9 / ticks);
+  printf("worst ns/tick:       %lld\n", worstNanos);
+  printf("worst fires/tick:    %lu\n", worstFires);
+  printf("mean occupancy:      %.2f / %d (target %d)\n", (double) occupancy / ticks, MAX_ASYNC_LOOPS, target);
+  printf("fires:               %lu\n", fires);
+  printf("attaches:            %lu (%lu rejected)\n", attaches, rejected);
+  printf("detaches:            %lu\n", detaches);
+#if ASYNC_LOOP_ABSOLUTE
+  printf("missed ticks:        %lu\n", AsyncLoop.missedTicks());
+#endif
+  printf("early:               %lu\n", early);
+  printf("late:                %lu\n", late);
+  printf("lost:                %lu\n", lost);
+  printf("after detach:        %lu\n", afterDetach);
+
+  return (early || late || lost || afterDetach) ? 1 : 0;
+}
@@ -3,9 +3,90 @@
 
 #include <avr/io.h>
 #include <avr/interrupt.h>
+#include <avr/pgmspace.h>
 
 #define RESOLUTION         65536    // Timer1 is 16 bit
-#define MAX_ASYNC_LOOPS    34
+#define MAX_ASYNC_LOOPS    16       // loops agregados en tiempo de ejecucion (attach)
+#define MAX_ASYNC_TASKS    8        // tareas fijas declaradas en tablas en flash
+#define NO_LOOP            255      // fin de la lista de vencimientos (o de la de espacios libres)
+#define INVALID_LOOP       0xFFFF   // resultado de attach cuando no queda espacio libre
+#define COMMAND_QUEUE_SIZE 8        // altas/bajas desde loop() pendientes de aplicar (potencia de 2)
+#define SPARE_LOOPS        4        // espacios reservados para altas desde loop() (potencia de 2)
+#define MAX_SLACK          0xFFFF   // tolerancia que siempre alinea el loop a un multiplo de su periodo
+
+// Modo tickless: la comparacion del Timer1 no se programa en cada tick sino
+// en el primer vencimiento de la lista (hasta TICKLESS_MAX_PERIOD ms), y el
+// ISR descuenta con la cuenta libre los ticks transcurridos. Los escaneos que
+// solo trabajan por momentos se agregan y quitan a demanda (ver Elevator,
+// Light y Coroutine), por lo que en reposo solo quedan los ciclos lentos
+// (display, leds). Reduce las interrupciones del tick, no las del Timer0 de
+// millis(), que sigue despertando al CPU cada 1.024 ms. Requiere el modo absoluto
+#ifndef ASYNC_LOOP_TICKLESS
+#define ASYNC_LOOP_TICKLESS 0
+#endif
+#define TICKLESS_MAX_PERIOD 50      // ms: de los ~262 ms de la cuenta de 16 bits quedan ~200 con interrupciones bloqueadas
+
+// Modo de vencimientos absolutos: el Timer1 cuenta libremente (prescaler /64,
+// 4 us por cuenta) y el tick se genera por comparacion (OCR1A). Si las
+// interrupciones estuvieron deshabilitadas mas de un tick, el ISR calcula
+// con el contador cuantos ticks transcurrieron (hasta ~262 ms) y los descuenta
+#ifndef ASYNC_LOOP_ABSOLUTE
+#define ASYNC_LOOP_ABSOLUTE ASYNC_LOOP_TICKLESS
+#endif
+
+#if ASYNC_LOOP_TICKLESS && ! ASYNC_LOOP_ABSOLUTE
+#error "el modo tickless requiere el modo absoluto"
+#endif
+
+// Con vencimientos absolutos, un loop ciclico que se atraso varios periodos
+// se ejecuta una vez por cada periodo perdido (1) o una unica vez (0); en
+// ambos casos conserva la fase de sus vencimientos
+#ifndef ASYNC_LOOP_CATCH_UP
+#define ASYNC_LOOP_CATCH_UP 1
+#endif
+
+// Timer que genera el tick:
+//  2: Timer2 en modo CTC, 1 ms exacto (pines 3 y 11 solo como salidas digitales)
+//  0: comparacion B del Timer0, cuyo periodo (1.024 ms) ya usa millis(); el
+//     tiempo excedente se acumula y descuenta como ticks adicionales
+//  1: Timer1 (requerido por el modo absoluto)
+// Con 2 o 0 el Timer1 queda para analogWrite() en los pines 9 y 10 (motor)
+#ifndef ASYNC_LOOP_TIMER
+#if ASYNC_LOOP_ABSOLUTE
+#define ASYNC_LOOP_TIMER 1
+#else
+#define ASYNC_LOOP_TIMER 2
+#endif
+#endif
+
+#if ASYNC_LOOP_TIMER != 1 && ASYNC_LOOP_ABSOLUTE
+#error "el modo absoluto requiere ASYNC_LOOP_TIMER 1"
+#endif
+
+#define TICK_COUNTS (F_CPU / 64 / 1000)  // cuentas por tick con prescaler /64 (Timer2 y modo absoluto)
+#define TIMER0_TICK_MICROS (64UL * 256 / (F_CPU / 1000000UL)) // periodo del Timer0
+
+// Perfilado ciclo a ciclo en simavr (ver profile/): las funciones medidas
+// se compilan sin expandir en linea para conservar su simbolo
+#ifndef PROFILE_SYMBOLS
+#define PROFILE_SYMBOLS 0
+#endif
+
+#if PROFILE_SYMBOLS
+#define PROFILED __attribute__((noinline))
+#else
+#define PROFILED
+#endif
+
+// Perfilado: registra por loop invocaciones y ciclos de CPU consumidos
+// (con 0 no se compila ningun codigo ni memoria adicional)
+#ifndef ASYNC_LOOP_PROFILE
+#define ASYNC_LOOP_PROFILE 0
+#endif
+
+#if ASYNC_LOOP_PROFILE
+class Print;
+#endif
 
 #define setTimeout(callback, millis) AsyncLoop.attach(callback, millis, AsynchLoop::ONE_TIME)
 #define setInterval(callback, millis) AsyncLoop.attach(callback, millis, AsynchLoop::CYCLIC)
@@ -15,24 +96,166 @@ class AsynchLoop
 {
 public:
 
-    typedef uint8_t LoopId;
-    typedef enum {CYCLIC, ONE_TIME} LoopType;
+    /*
+     * Identificador de un loop: el byte bajo es el espacio que ocupa y el alto
+     * la generacion de ese espacio, que se incrementa cada vez que se libera.
+     * Asi un id que ya no es valido (loop vencido o eliminado) no afecta al
+     * loop que reutilice el mismo espacio
+     */
+    typedef uint16_t LoopId;
+    typedef enum : uint8_t {CYCLIC, ONE_TIME} LoopType;
+
+    /*
+     * Define la prioridad del callback, que determina donde se ejecuta:
+     *  LOW_PRIORITY:  diferido, desde dispatch() en loop(); cualquier tick lo interrumpe
+     *  HIGH_PRIORITY: en el ISR con las interrupciones rehabilitadas; solo lo
+     *                 interrumpen los CRITICAL del tick siguiente
+     *  CRITICAL:      en el ISR con las interrupciones deshabilitadas; nada lo interrumpe
+     *
+     * Latencia maxima de un CRITICAL (ej. Elevator::_scan): la ventana mas larga
+     * con interrupciones deshabilitadas en el resto del programa (el show() de
+     * Adafruit_NeoPixel con 39 pixeles, ~1.2 ms) mas los CRITICAL que vencen en
+     * el mismo tick. Los HIGH_PRIORITY y LOW_PRIORITY nunca la aumentan.
+     */
+    typedef enum : uint8_t {LOW_PRIORITY, HIGH_PRIORITY, CRITICAL} Priority;
+
+    /*
+     * Tarea ciclica fija, declarada en una tabla constante en flash con su
+     * periodo incluido (en RAM solo ocupa un nodo de la lista de vencimientos):
+     *
+     *   const AsynchLoop::Task tasks[] PROGMEM = {
+     *     {handler, (void *) contexto, periodo, AsynchLoop::LOW_PRIORITY, tolerancia},
+     *   };
+     *   AsyncLoop.attach(tasks);
+     */
+    typedef struct {
+        void (*handler)(void *);
+        void *context;                 // argumento que recibe el handler
+        uint16_t period;               // milisegundos
+        Priority priority;
+        uint16_t slack;                // tolerancia del primer vencimiento (ver attach)
+    } Task;
 
     /**
      * Agrega una funcion callback con un intervalo de ejecucion determinado
+     * Por defecto el callback se ejecuta diferido, desde dispatch(); solo los
+     * callbacks breves y seguros dentro de una interrupcion deben usar CRITICAL
+     * Retorna INVALID_LOOP si ya hay MAX_ASYNC_LOOPS loops activos (desde
+     * loop() tambien si ya se usaron los SPARE_LOOPS espacios de este tick
+     * o si la cola de COMMAND_QUEUE_SIZE altas y bajas esta llena)
+     *
+     * Desde loop() el alta se encola y el ISR la aplica al comienzo del tick
+     * siguiente, por lo que no se deshabilitan las interrupciones
+     *
+     * Con slack (ms) el primer vencimiento puede demorarse hasta esa cantidad
+     * de ticks para coincidir con un multiplo de su periodo contado desde el
+     * arranque del timer, o en su defecto con otro vencimiento ya programado.
+     * Asi los loops de periodos multiplos entre si (ej. 100, 200 y 800 ms)
+     * mantienen sus fases alineadas y un mismo tick atiende a todos ellos.
+     * Con el tick fijo de 1 ms esto no reduce las interrupciones, solo las
+     * ejecuciones de dispatch(); con ASYNC_LOOP_TICKLESS el timer solo
+     * interrumpe en los ticks con vencimientos y cada grupo alineado cuesta
+     * una sola interrupcion
+     */
+    LoopId attach(void (*isr)(), long milliseconds, LoopType loopType = CYCLIC, Priority priority = LOW_PRIORITY,
+                  uint16_t slack = 0);
+
+    /**
+     * Idem anterior, pero el callback recibe el contexto indicado como argumento
+     * (permite que un mismo handler atienda a varias instancias)
+     */
+    LoopId attach(void (*handler)(void *), void *context, long milliseconds, LoopType loopType = CYCLIC,
+                  Priority priority = LOW_PRIORITY, uint16_t slack = 0);
+
+    /**
+     * Agrega las tareas fijas de una tabla en flash (una tarea ya agregada
+     * no se duplica; una quitada con detach vuelve a su espacio)
+     * Retorna la cantidad agregada (menor a N si se excede MAX_ASYNC_TASKS)
      */
-    LoopId attach(void (*isr)(), long milliseconds, LoopType loopType = CYCLIC);
+    template <uint8_t N>
+    uint8_t attach(const Task (&tasks)[N]) {
+        uint8_t attached = 0;
+        for ( uint8_t i = 0 ; i < N ; i++ )
+            attached += _attachTask(&tasks[i]);
+        return attached;
+    }
 
     /**
      * Elimina el callback correspondiente al id
-     * 
+     * No tiene efecto si el id ya no es valido
+     * Desde loop() la baja tambien se encola (el callback ya no se ejecuta);
+     * si la cola esta llena se aplica en el acto, con las interrupciones
+     * deshabilitadas
      */
     void detach(LoopId);
 
     /**
-     * Recorre el array de callbacks y ejecuta cada uno segun corresponda
+     * Quita las tareas fijas de una tabla, desde cualquier contexto e
+     * incluso desde su propio handler: los escaneos que solo trabajan por
+     * momentos se quitan al concluir y attach los vuelve a agregar
+     * Descarta las ejecuciones diferidas pendientes; no tiene efecto si no
+     * estaban agregadas
      */
-    void callAsyncLoops(void);
+    template <uint8_t N>
+    void detach(const Task (&tasks)[N]) {
+        for ( uint8_t i = 0 ; i < N ; i++ )
+            _detachTask(&tasks[i]);
+    }
+
+    /**
+     * Decrementa el primer vencimiento de la lista y ejecuta los
+     * callbacks vencidos (costo O(1) mas la cantidad de vencimientos)
+     */
+    PROFILED void callAsyncLoops(void);
+
+    /**
+     * Ejecuta los callbacks diferidos que vencieron desde la ultima llamada
+     * Debe invocarse continuamente desde loop()
+     */
+    void dispatch(void);
+
+    /**
+     * Retorna 1 si hay callbacks diferidos o altas/bajas encoladas que
+     * requieren otro dispatch() o tick (invocar con interrupciones deshabilitadas
+     * antes de dormir, para no perder un vencimiento ocurrido mientras tanto)
+     */
+    uint8_t pending(void);
+
+    /**
+     * Milisegundos hasta el proximo vencimiento de un loop agregado con attach
+     * (setTimeout, setInterval, corrutinas), o -1 si no hay ninguno.
+     * Las tareas fijas en flash no se consideran: son ciclos de escaneo
+     */
+    long nextDeadline(void);
+
+    /**
+     * Ticks (ms) transcurridos desde el primer attach: base de tiempo
+     * comun del registro de entradas y de su reproduccion en el host
+     */
+    unsigned long ticks(void);
+
+    /**
+     * Loops agregados con attach que siguen activos (de MAX_ASYNC_LOOPS),
+     * incluidas las altas encoladas desde loop()
+     */
+    uint8_t active(void);
+
+#if ASYNC_LOOP_ABSOLUTE
+    /**
+     * Retorna la cantidad de ticks que no generaron su propia interrupcion
+     * (descontados luego por el ISR siguiente)
+     */
+    unsigned long missedTicks(void);
+#endif
+
+#if ASYNC_LOOP_PROFILE
+    /**
+     * Vuelca por Serial (u otro Print) la tabla de perfilado de cada loop:
+     * invocaciones, ciclos de la ultima ejecucion, maximo y acumulado, y
+     * cantidad de ejecuciones y ticks que superaron el periodo del timer
+     */
+    void report(Print &out);
+#endif
 
 private:
     
@@ -42,21 +265,155 @@ private:
 	char oldSREG;					// To hold Status Register while ints disabled
     //void (*_asyncLoops[MAX_ASYNC_LOOPS])(void);
 
+    // Cantidad de ticks con signo (negativa si hay atraso): 32 bits alcanzan
+    // para ~24 dias, mas que cualquier periodo o suma de deltas de la lista
+    typedef int32_t Ticks;
+
+    /*
+     * Los loops activos forman una lista ordenada por vencimiento (delta list):
+     * cada nodo guarda los ticks que faltan a partir del vencimiento del nodo
+     * anterior, por lo que en cada tick solo se decrementa el primero
+     */
+    typedef struct {
+        Ticks delta;                   // ticks restantes respecto del nodo anterior
+        uint8_t next;                  // siguiente nodo de la lista (NO_LOOP si es el ultimo)
+        volatile uint8_t pending;      // vencimientos diferidos aun no ejecutados
+    } Node;
+
+    // Indice de nodo: [0, MAX_ASYNC_LOOPS) son los loops y a continuacion las tareas fijas
+    typedef uint8_t Slot;
+
     typedef struct {
+        Node node;
         LoopType loopType;
-        long long period;
-        long long counter;
-        void (*handlerFunction)(void);
+        Priority priority;
+        Ticks period;
+        union {
+            void (*handlerFunction)(void);
+            void (*contextFunction)(void *);
+        };
+        void *context;
+        uint8_t withContext;           // 1 si se invoca contextFunction(context)
+        uint16_t slack;                // tolerancia del primer vencimiento
+        uint8_t generation;            // generacion del espacio (byte alto del LoopId)
     } Loop;
 
+    typedef struct {
+        Node node;
+        const Task *task;              // definicion de la tarea (en flash)
+        uint8_t attached;              // 0 luego de detach (conserva el espacio)
+    } TaskNode;
+
     Loop _loops[MAX_ASYNC_LOOPS];
+    TaskNode _tasks[MAX_ASYNC_TASKS];
+    uint8_t _taskCount = 0;
+    uint8_t _head = NO_LOOP;           // primer loop a vencer
+    unsigned long _now = 0;            // ticks descontados desde el arranque (referencia de las fases)
+    uint8_t _free = NO_LOOP;           // primer espacio libre (enlazados mediante next)
+    uint8_t _running = NO_LOOP;        // loop CRITICAL cuyo callback se esta ejecutando
+    uint8_t _dispatching[CRITICAL] = {NO_LOOP, NO_LOOP}; // idem para cada prioridad diferida
+    volatile uint8_t _pending[CRITICAL] = {0, 0};        // vencimientos pendientes por prioridad
+    uint8_t _highPhase = 0;            // 1 mientras el ISR ejecuta los HIGH_PRIORITY
+    volatile uint8_t _isrDepth = 0;    // anidamiento del ISR (0: contexto de loop())
+
+    /*
+     * Cola de un productor (loop()) y un consumidor (el ISR) con las altas y
+     * bajas pedidas desde loop(). Cada indice lo escribe un solo contexto y
+     * en el AVR la escritura de un byte es atomica, por lo que no se necesita
+     * deshabilitar interrupciones. Los espacios para las altas se toman de
+     * una segunda cola (productor el ISR) que este repone en cada tick
+     */
+    typedef enum : uint8_t {ATTACH_COMMAND, DETACH_COMMAND} CommandType;
+
+    typedef struct {
+        uint8_t type;
+        LoopId loopId;
+    } Command;
+
+    volatile Command _commands[COMMAND_QUEUE_SIZE];
+    volatile uint8_t _commandHead = 0; // escrito solo desde loop()
+    volatile uint8_t _commandTail = 0; // escrito solo desde el ISR
+    volatile Slot _spares[SPARE_LOOPS];
+    volatile uint8_t _spareHead = 0;   // escrito solo desde el ISR
+    volatile uint8_t _spareTail = 0;   // escrito solo desde loop()
+
+    uint8_t _queueFull(void);
+    uint8_t _post(CommandType type, LoopId loopId);
+    void _applyCommands(void);
+    uint8_t _detachPosted(Slot slot);
+    void _detach(LoopId loopId);
+    void _fill(Slot slot, void (*handler)(void *), void *context, uint8_t withContext,
+               long milliseconds, LoopType loopType, Priority priority, uint16_t slack);
+
+    LoopId _attach(void (*handler)(void *), void *context, uint8_t withContext,
+                   long milliseconds, LoopType loopType, Priority priority, uint16_t slack);
+    uint8_t _attachTask(const Task *task);
+    void _detachTask(const Task *task);
+
+    Node &_node(Slot slot);
+    Ticks _period(Slot slot);
+    Priority _priority(Slot slot);
+    uint8_t _cyclic(Slot slot);
+
+    void _runPending(Priority priority);
+    void _call(Slot slot);
+    void _invoke(Slot slot);
 
+#if ASYNC_LOOP_PROFILE
+    typedef struct {
+        unsigned long count;           // cantidad de invocaciones
+        unsigned long total;           // ciclos acumulados
+        uint16_t last;                 // ciclos de la ultima invocacion (satura en 65535)
+        uint16_t max;                  // maximo de ciclos de una invocacion
+        uint16_t overruns;             // invocaciones que superaron el periodo del timer
+    } Profile;
+
+    Profile _profile[MAX_ASYNC_LOOPS + MAX_ASYNC_TASKS];
+    volatile unsigned long _cycleBase = 0; // ciclos transcurridos hasta el inicio del periodo actual
+#if ASYNC_LOOP_ABSOLUTE
+    uint16_t _cycleCount = 0;          // cuenta del Timer1 correspondiente a _cycleBase
+#endif
+    uint16_t _overruns = 0;            // ticks cuyo trabajo supero el periodo
+#if ASYNC_LOOP_TIMER == 1
+    uint8_t _scale = 0;                // log2 del prescaler seleccionado por setPeriod
+#endif
+
+    unsigned long _cycles(void);
+#endif
+
+    void _insert(Slot slot, Ticks ticks);
+    void _schedule(Slot slot, Ticks ticks, uint16_t slack);
+    void _reschedule(Slot slot, Ticks late);
+    void _remove(Slot slot);
+    void _release(Slot slot);
+
+#if ASYNC_LOOP_ABSOLUTE
+    uint16_t _deadline = 0;            // cuenta del Timer1 del proximo tick
+    volatile unsigned long _missedTicks = 0;
+
+    long _elapsedTicks(void);
+#endif
+
+#if ASYNC_LOOP_TICKLESS
+    uint16_t _programmed = 1;          // ticks hasta la comparacion programada en OCR1A
+
+    Ticks _unaccounted(void);
+    void _wake(void);
+    void _program(void);
+#endif
+
+#if ASYNC_LOOP_TIMER == 0
+    uint16_t _extraMicros = 0;         // excedente de los periodos del Timer0 sobre 1 ms
+#endif
+
+#if ASYNC_LOOP_TIMER == 1
     void start();
     void stop();
     void restart();
 	void resume();
 	unsigned long read();
     void setPeriod(long microseconds);
+#endif
 
 };
 
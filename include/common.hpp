@@ -8,6 +8,9 @@
 
 #include <Arduino.h>
 #include "async-loop.hpp"
+#include "station.hpp"
+#include "trace.hpp"
+#include "recorder.hpp"
 
 #define arrayLength(a)  sizeof(a)/sizeof(a[0])
 
@@ -0,0 +1,98 @@
+/*
+ * coroutine.hpp
+ * Copyright 2020 - Juan C. Bryksa (jcbryksa@gmail.com)
+ */
+
+#ifndef COROUTINE_H
+#define COROUTINE_H
+
+#include "common.hpp"
+
+/*
+ * Corrutinas sin pila (estilo protothreads) planificadas por AsyncLoop
+ *
+ * El cuerpo es una funcion que recibe la corrutina y delimita su secuencia
+ * con CO_BEGIN/CO_END; entre ambas puede esperar sin bloquear:
+ *
+ *   Coroutine::Result secuencia(Coroutine *co) {
+ *     CO_BEGIN(co);
+ *     encender();
+ *     CO_DELAY(co, 500);              // continua 500 ms despues
+ *     CO_AWAIT(co, listo());          // continua cuando listo() sea verdadero
+ *     apagar();
+ *     CO_END(co);
+ *   }
+ *
+ * Las variables locales del cuerpo no se conservan entre esperas (usar
+ * variables estaticas o miembros) y no se puede esperar dentro de un switch
+ *
+ * Si al esperar no queda espacio en AsyncLoop la corrutina no se pierde:
+ * queda demorada y un escaneo de 1 ms reintenta su reanudacion (descontando
+ * la espera ya transcurrida) hasta que se libere un espacio; el escaneo se
+ * quita al no quedar demoradas
+ */
+#define CO_BEGIN(co)        switch ( (co)->_line ) { case 0:
+#define CO_YIELD(co)        do { (co)->_line = __LINE__; return Coroutine::WAITING; case __LINE__: ; } while (0)
+#define CO_AWAIT(co, cond)  do { (co)->_line = __LINE__; __attribute__((fallthrough)); case __LINE__: if ( !(cond) ) return Coroutine::WAITING; } while (0)
+#define CO_DELAY(co, ms)    do { (co)->_line = __LINE__; (co)->_delay = (ms); return Coroutine::DELAYED; case __LINE__: ; } while (0)
+#define CO_END(co)          } (co)->_line = 0; return Coroutine::ENDED
+
+
+class Coroutine {
+
+  friend struct CoroutineTest;   // escaneo de reintentos (test/test_coroutine)
+
+public:
+
+  // Define el resultado de cada tramo ejecutado del cuerpo
+  typedef enum : uint8_t {WAITING, DELAYED, ENDED} Result;
+
+  typedef Result (*Body)(Coroutine *co);
+
+  Coroutine(Body body, AsynchLoop::Priority priority = AsynchLoop::LOW_PRIORITY);
+
+  /**
+   * Inicia (o reinicia) la secuencia desde el principio
+   * El primer tramo se ejecuta en el contexto que la invoca
+   */
+  void start(void);
+
+  /**
+   * Detiene la secuencia sin completarla
+   */
+  void stop(void);
+
+  /**
+   * Retorna 1 si la secuencia no ha concluido
+   */
+  uint8_t running(void);
+
+  /**
+   * Retorna 1 si la reanudacion espera un espacio libre en AsyncLoop
+   */
+  uint8_t stalled(void);
+
+  uint16_t _line;                  // linea donde continua el cuerpo (0: inicio), usado por CO_*
+  unsigned int _delay;             // espera solicitada por CO_DELAY en milisegundos
+
+private:
+
+  Body _body;                      // funcion con la secuencia
+  AsynchLoop::Priority _priority;  // prioridad con la que AsyncLoop la reanuda
+  AsynchLoop::LoopId _loopId;      // timeout que la reanudara (INVALID_LOOP si no hay)
+  Coroutine *_nextStalled;         // siguiente corrutina demorada por falta de espacio
+
+  static Coroutine *_stalled;      // corrutinas demoradas (reintentadas por _retry)
+  static uint8_t _retrying;        // 1 mientras el escaneo de reintentos esta agregado
+  static const AsynchLoop::Task _tasks[]; // escaneo de reintentos (en flash)
+
+  void _run(void);
+  void _schedule(unsigned int milliseconds);
+  void _unstall(void);
+  static void _resume(void *coroutine);
+  static void _retry(void *);
+
+};
+
+
+#endif
@@ -7,6 +7,7 @@
 #define DISPLAY_H
 
 #include "common.hpp"
+#include "state-machine.hpp"
 
 
 class Display {
@@ -14,26 +15,52 @@ class Display {
 public:
 
   // Define un tipo de ejfecto que puede estar ejecutando el display
-  typedef enum {NONE, BLINK, RIGHT_ROTATION, LEFT_ROTATION, SHIFT_UP, SHIFT_DOWN} Effect;
+  typedef enum : uint8_t {NONE, BLINK, RIGHT_ROTATION, LEFT_ROTATION, SHIFT_UP, SHIFT_DOWN} Effect;
 
-  static void init(const uint8_t *displayPins, uint8_t commonPinLevel = HIGH);
+  static void init(void);      // pines y terminal comun segun Station; sigue los recorridos del ascensor
   static void show(uint8_t value);
   static void effect(Effect effect);
   static void clearEffect(void);
+  static uint8_t idle(void);     // 1 si no hay ningun efecto activo
 
 private:
 
-  static const uint8_t *pins;    // array de pines
-  static uint8_t common;         // terminal comun (puede ser LOW o HIGH)
-  static Effect _activeEffect;   // efecto actualmente activo
+  friend struct TransitionTest;  // tablas de transiciones (test/test_state_machine)
+
+  static constexpr uint8_t EFFECTS = SHIFT_DOWN + 1;
+
+  // Eventos: tick del ciclo de efectos y seleccion de un efecto (SELECT + efecto)
+  enum : uint8_t {TICK, SELECT, EVENTS = SELECT + EFFECTS};
+
+  static const StateTransition _transitions[EFFECTS][EVENTS]; // efectos (en flash)
+  typedef StateMachine<EFFECTS, EVENTS, _transitions, DISPLAY_MACHINE> Machine;
+  static Machine _machine;       // estado: efecto actualmente activo
+
   static uint8_t _value;         // valor decimal que muestra el display
   static uint8_t _effectStep;    // numero de secuencia o escena que se esta ejecutando en un efecto
   static uint8_t _blinkCounter;  // contador utilizado para el efecto blink
+  static const AsynchLoop::Task _tasks[]; // ciclo de efectos (en flash)
+  static const uint8_t _digits[];         // segmentos de cada digito (en flash)
+  static const uint8_t _shiftUp[];        // secuencias de SHIFT_UP y SHIFT_DOWN (en flash)
+  static const uint8_t _shiftDown[];
 
   static void _setSegment(uint8_t segment);
   static void _clearSegment(uint8_t segment);
-  static void _playEffect(void);
-  static void _setSegmentsByte(uint8_t value);
+  static void _playEffect(void *);
+  static void _elevatorRequested(uint8_t value);
+  static void _elevatorArrived(uint8_t floor);
+  static void _blinkStep(void);
+  static void _rightRotationStep(void);
+  static void _leftRotationStep(void);
+  static void _shiftStep(const uint8_t *sequence);
+  static void _shiftUpStep(void);
+  static void _shiftDownStep(void);
+  static void _showValue(void);
+  static void _startBlink(void);
+  static void _startRightRotation(void);
+  static void _startLeftRotation(void);
+  static void _startShift(void);
+  PROFILED static void _setSegmentsByte(uint8_t value);
 
 };
 
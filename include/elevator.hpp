@@ -7,6 +7,9 @@
 #define ELEVATOR_H
 
 #include "common.hpp"
+#include "coroutine.hpp"
+#include "event-bus.hpp"
+#include "state-machine.hpp"
 
 #define NO_FLOOR 255
 #define ON       1
@@ -21,17 +24,27 @@ class Elevator {
 public:
 
   // Define el estado del ascensor
-  typedef enum {READY, BUSY, WAITING, ERROR} Status;
+  typedef enum : uint8_t {READY, BUSY, WAITING, ERROR} Status;
 
-  static void init(const uint8_t *floorPins, const uint8_t floors, const uint8_t enginePinA,
-                   const uint8_t enginePinB, const uint8_t buzzerPin, void (*endCallback)(uint8_t) = NULL );
+  // Define la direccion (o sentido) hacia la cual se desplaza el ascensor
+  typedef enum : uint8_t {NONE, UP, DOWN} Direction;
+
+  static void init(void);      // pisos, motor y buzzer segun Station
   
   /**
    * Determina a que piso debe dirigirse el ascensor
-   * El segundo argumento (opcional) establece una funcion
-   * callback que sera ejecutada cuando finalice el recorrido solicitado
+   * Publica ELEVATOR_REQUESTED con el sentido del recorrido (NONE si parte
+   * entre pisos y no se lo conoce) y al concluirlo ELEVATOR_ARRIVED
+   * Con wait OFF parte sin la espera previa (ej. al retomar un recorrido en el arranque)
+   */
+  static void goTo(uint8_t floor, uint8_t wait = ON);
+
+  /**
+   * Establece el ultimo piso conocido y el sentido del recorrido que estaba
+   * en curso (ej. leidos del Journal), para que un recorrido que parte entre
+   * pisos se dirija directamente al piso solicitado
    */
-  static void goTo(uint8_t floor, void (*endCallback)(uint8_t) = NULL );
+  static void restore(uint8_t lastFloor, Direction direction);
 
   /**
    * Retorna el estado actual del ascensor
@@ -43,31 +56,64 @@ public:
    */
   static uint8_t floor(void);
 
+  /**
+   * Ultimo piso por el que paso el ascensor, sentido y destino del
+   * recorrido en curso (NONE y NO_FLOOR cuando esta detenido)
+   */
+  static uint8_t lastFloor(void);
+  static Direction direction(void);
+  static uint8_t target(void);
+
+  /**
+   * Milisegundos desde el arranque hasta que el ascensor quedo por primera
+   * vez listo en un piso (0 mientras no lo este)
+   */
+  static unsigned long bootTime(void);
+
+  /**
+   * Retorna 1 si el ascensor esta detenido y sin recorridos solicitados
+   */
+  static uint8_t idle(void);
+
 private:
 
-  // Define la direccion (o sentido) hacia la cual se desplaza el ascensor
-  typedef enum {NONE, UP, DOWN} Direction;
-
-  static const uint8_t *_floorPins;      // pines donde se conectan los finales de carrera de cada piso
-  static uint8_t _floors;                // cantidad total de pisos
-  static uint8_t _enginePinA;            // pin A del motor
-  static uint8_t _enginePinB;            // pin B del motor
-  static uint8_t _buzzerPin;             // pin conectado al buzzer (beep)
-  static uint8_t _pwmValue;              // No utilizado en la solucion programada
+  friend struct TransitionTest;  // tablas de transiciones (test/test_state_machine)
+
+  static uint8_t _pwmValue;              // ciclo de trabajo del motor (requiere ASYNC_LOOP_TIMER distinto de 1)
   static uint8_t _currentFloor;          // piso en el cual se encuentra el ascensor actualmente
   static uint8_t _goToFloor;             // piso solicitado (cuando concluye el recorrido toma el valor NO_FLOOR)
   static Direction _currentMovement;     // movimiento actual del ascensor (arriba, abajo o ninguno)
-  static void (*_endCallback)(uint8_t);  // funcion callback a invocar cuando finaliza un recorrido
-  static Status _status;                 // estado actual del ascensor (listo, ocupado, en espera)
+  static uint8_t _lastFloor;             // ultimo piso detectado por los finales de carrera
+  static Direction _tripDirection;       // sentido del recorrido en curso (sin el frenado)
+  static unsigned long _bootTime;        // ver bootTime()
+  static uint8_t _buzzing;               // ON mientras debe sonar el buzzer
+  static AsynchLoop::LoopId _buzzerLoop; // ciclo "beep" (INVALID_LOOP si attach fallo: _scan reintenta)
+
+  static constexpr uint8_t STATES = ERROR + 1;
+
+  // Eventos de los escaneos (REQUESTED, AT_TARGET) y de la corrutina de partida
+  enum : uint8_t {REQUESTED, AT_TARGET, CALLED, DEPARTED, EVENTS};
+
+  static const StateTransition _transitions[STATES][EVENTS]; // recorridos (en flash)
+  typedef StateMachine<STATES, EVENTS, _transitions, ELEVATOR_MACHINE> Machine;
+  static Machine _machine;               // estado actual del ascensor (listo, ocupado, en espera)
+  static const AsynchLoop::Task _tasks[]; // escaneo ciclico (en flash)
+  static Coroutine _departure;           // secuencia de espera previa a cada recorrido
+  static Coroutine _braking;             // secuencia de frenado al llegar al piso
 
   static void _move(Direction direction);
   static void _stop(void);
   static void _brake(void);
-  static void _scan(void);
+  PROFILED static void _scan(void *);
   static void _checkCurrentFloor(void);
-  static void _beep(uint8_t status = ON);
+  static void _depart(void);
+  static Direction _heading(void);
+  static void _arrive(void);
+  static void _beep(void);
+  static void _buzzer(uint8_t status);
   static void _playBuzzer(void);
-  static void _setReady(void);
+  static Coroutine::Result _departureSequence(Coroutine *co);
+  static Coroutine::Result _brakeSequence(Coroutine *co);
 
 };
 
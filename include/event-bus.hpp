@@ -0,0 +1,86 @@
+/*
+ * event-bus.hpp
+ * Copyright 2020 - Juan C. Bryksa (jcbryksa@gmail.com)
+ */
+
+#ifndef EVENT_BUS_H
+#define EVENT_BUS_H
+
+#include "common.hpp"
+
+#define EVENT_QUEUE_SIZE 8  // eventos publicados aun no entregados (potencia de 2)
+#define MAX_SUBSCRIBERS  6
+
+/*
+ * Bus de eventos: los productores (scans, ISRs) publican eventos de dos bytes
+ * en una cola circular fija y los suscriptores los reciben desde loop(), por
+ * lo que ningun trabajo de display o luces se ejecuta dentro de un ISR.
+ * Display, Light y el led indicador reaccionan a los eventos suscribiendose;
+ * ningun modulo invoca a los otros directamente.
+ * La reserva del lugar en la cola es una seccion critica breve (cli()): la
+ * cola no es lock-free, pero la escritura del evento queda fuera de ella
+ */
+class EventBus {
+
+public:
+
+  // Define los eventos de la estacion (el valor depende del evento)
+  typedef enum : uint8_t {
+    KEY_RELEASED,       // tecla liberada (valor: numero de tecla)
+    ELEVATOR_REQUESTED, // recorrido solicitado (valor: Elevator::Direction << 4 | piso destino)
+    ELEVATOR_ARRIVED,   // el ascensor concluyo un recorrido (valor: piso)
+    LIGHT_SWITCHED      // luces encendidas (valor 1) o apagadas (valor 0)
+  } EventType;
+
+  /**
+   * Publica un evento (desde cualquier contexto, incluso un ISR); solo la
+   * reserva del lugar deshabilita las interrupciones
+   * Retorna 0 si la cola esta llena; el evento se descarta sin esperar
+   */
+  static uint8_t post(EventType type, uint8_t value = 0);
+
+  /**
+   * Registra un handler para el tipo de evento indicado
+   * Retorna 0 si ya hay MAX_SUBSCRIBERS suscriptores
+   */
+  static uint8_t subscribe(EventType type, void (*handler)(uint8_t value));
+
+  /**
+   * Entrega los eventos pendientes a sus suscriptores
+   * Debe invocarse continuamente desde loop()
+   */
+  static void dispatch(void);
+
+  /**
+   * Retorna 1 si hay eventos publicados aun no entregados
+   */
+  static uint8_t pending(void);
+
+  /**
+   * Retorna la cantidad de eventos descartados por cola llena (satura en 255)
+   */
+  static uint8_t dropped(void);
+
+private:
+
+  typedef struct {
+    uint8_t type;
+    uint8_t value;
+    uint8_t ready;                  // 1 cuando el productor termino de escribirlo
+  } Event;
+
+  typedef struct {
+    uint8_t type;
+    void (*handler)(uint8_t);
+  } Subscriber;
+
+  static volatile Event _events[EVENT_QUEUE_SIZE];
+  static volatile uint8_t _head;    // proximo lugar a reservar (productores)
+  static volatile uint8_t _tail;    // proximo evento a entregar (escrito solo desde loop())
+  static volatile uint8_t _dropped;
+  static Subscriber _subscribers[MAX_SUBSCRIBERS];
+  static uint8_t _subscriberCount;
+
+};
+
+#endif
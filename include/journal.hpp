@@ -0,0 +1,92 @@
+/*
+ * journal.hpp
+ * Copyright 2020 - Juan C. Bryksa (jcbryksa@gmail.com)
+ */
+
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <avr/eeprom.h>
+#include <util/crc16.h>
+#include "common.hpp"
+
+// Persistencia del estado de la estacion en la EEPROM
+// (0: deshabilitado, cada arranque parte del estado de fabrica)
+#ifndef JOURNAL_ENABLED
+#define JOURNAL_ENABLED 1
+#endif
+
+#define JOURNAL_ADDRESS  0      // primer byte de la EEPROM utilizado
+#define JOURNAL_SLOTS    32     // registros del anillo (100.000 escrituras por byte cada uno)
+#define JOURNAL_VERSION  0x01   // cambiarlo invalida los registros con otro formato
+
+#if JOURNAL_ENABLED
+
+/*
+ * Journal en la EEPROM con nivelacion de desgaste: cada cambio de estado se
+ * escribe en el registro siguiente de un anillo, con un numero de secuencia
+ * y un CRC. Al arrancar el vigente es el ultimo de la secuencia con CRC
+ * valido, por lo que un corte durante la escritura conserva el anterior.
+ * Los bytes se escriben desde loop() de a uno, solo cuando la EEPROM esta
+ * lista (~3.4 ms por byte), sin detener al scheduler
+ */
+class Journal {
+
+public:
+
+  typedef struct {
+    uint8_t floor;        // ultimo piso conocido (NO_FLOOR: ninguno)
+    uint8_t direction;    // sentido del recorrido en curso (Elevator::Direction)
+    uint8_t target;       // piso de destino del recorrido en curso (NO_FLOOR: ninguno)
+    uint8_t changeType;   // proxima combinacion de escenas de las luces
+    uint16_t trips;       // recorridos concluidos
+    uint16_t boots;       // arranques
+  } State;
+
+  /**
+   * Lee el registro vigente y cuenta el arranque. snapshot completa el
+   * estado actual de la estacion (todo salvo los contadores)
+   * Retorna 0 si no hay ningun registro valido (EEPROM virgen)
+   */
+  static uint8_t init(void (*snapshot)(State &state));
+
+  /**
+   * Estado vigente (el restaurado en el arranque y luego el ultimo guardado)
+   */
+  static const State &state(void);
+
+  /**
+   * Guarda el estado si cambio y avanza la escritura en curso
+   * (invocar continuamente desde loop())
+   */
+  static void poll(void);
+
+  /**
+   * Retorna 1 mientras haya una escritura en curso o pendiente
+   */
+  static uint8_t busy(void);
+
+private:
+
+  typedef struct {
+    uint8_t sequence;
+    State state;
+    uint8_t crc;
+  } Record;
+
+  static void (*_snapshot)(State &);
+  static State _state;
+  static Record _record;             // registro que se esta escribiendo
+  static uint8_t _slot;              // registro del anillo a escribir
+  static uint8_t _written;           // bytes de _record ya escritos (sizeof(Record): ninguno en curso)
+  static uint8_t _dirty;             // 1 si _state cambio y aun no se comenzo a escribir
+
+  static uint8_t _crc(const Record &record);
+  static Record *_address(uint8_t slot);
+  static void _tripEnded(uint8_t floor);
+
+};
+
+#endif
+
+#endif
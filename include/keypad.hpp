@@ -7,25 +7,33 @@
 #define keypad_h
 
 #include "common.hpp"
+#include "event-bus.hpp"
 
-#define MAX_BUTTONS 10
-
+/*
+ * Teclas de la estacion: Station::KEYS pulsadores (ver Station::keyPin)
+ */
 class Keypad {
 
-  static const uint8_t *_pins;            // array de pines correspondiente a los switches
   static uint8_t _trigger;                // nivel de disparo (LOW o HIGH)
-  static uint8_t _quantity;               // cantidad total de switches
-  static uint8_t _pressed[MAX_BUTTONS];   // array de flags que determinan si se encuentran presionados (lo utiliza la logica de eliminacion de rebote)
+  static uint8_t _pressed[Station::KEYS]; // array de flags que determinan si se encuentran presionados (lo utiliza la logica de eliminacion de rebote)
   static unsigned long _timestamp;        // almacena un timestamp (lo utiliza la la eliminacion de rebote)
-  static unsigned long _debounceInterval; // valor de espera en milisegundos para la eliminacion de rebote
+  static uint16_t _debounceInterval;      // valor de espera en milisegundos para la eliminacion de rebote
 
-  static void (*_handler)(uint8_t);
   static void (**_handlers)(void);
 
 public:
 
-  static void init(const uint8_t *pins, uint8_t quantity, void (*handler)(uint8_t), uint8_t trigger = LOW, unsigned long debounceInterval = 100);
-  static void scan(void);
+  static void init(uint8_t trigger = LOW, uint16_t debounceInterval = 100);
+
+  /**
+   * Publica un evento KEY_RELEASED con cada liberacion de tecla
+   */
+  PROFILED static void scan(void);
+
+  /**
+   * Retorna 1 si no hay teclas presionadas ni un rebote en curso
+   */
+  static uint8_t idle(void);
 
 };
 
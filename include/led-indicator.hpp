@@ -8,33 +8,31 @@
 
 #include "common.hpp"
 
-#define MAX_LEDS 20
-
+/*
+ * Leds indicadores de la estacion: Station::LEDS leds (ver Station::ledPins)
+ */
 class LedIndicator {
 
 public:
 
   // Define el estado de los leds
-  typedef enum {OFF, ON, BLINK_SLOW, BLINK_MEDIUM, BLINK_FAST} LedStatus;
+  typedef enum : uint8_t {OFF, ON, BLINK_SLOW, BLINK_MEDIUM, BLINK_FAST} LedStatus;
 
-  static void init(const uint8_t *ledIndicatorPins, uint8_t quantity, uint8_t commonPinLevel = HIGH);
+  static void init(void);
   static void on(uint8_t ind);
   static void off(uint8_t ind);
   static uint8_t toggle(uint8_t ind);
   static void blink(uint8_t ind, LedIndicator::LedStatus blinkStatus = LedIndicator::BLINK_MEDIUM);
   static LedIndicator::LedStatus read(uint8_t ind);
+  static uint8_t idle(void);   // 1 si ningun led esta en blink
 
 private:
 
-  static const uint8_t * _pins;       // array de pines conectado a cada led
-  static uint8_t _quantity;           // cantidad total de leds
-  static LedStatus _status[MAX_LEDS]; // array de estado de cada led
-  static uint8_t _common;             // terminal comun (puede ser LOW o HIGH)
+  static LedStatus _status[Station::LEDS]; // array de estado de cada led
+
+  static const AsynchLoop::Task _blinkTasks[]; // ciclos de blink (en flash)
 
-  static void _blink(LedIndicator::LedStatus blinkStatus);
-  static void _blinkSlow(void);   // establece el efecto blink con velocidad baja
-  static void _blinkMedium(void); // idem con velocidad media
-  static void _blinkFast(void);   // idem con velocidad alta
+  static void _blink(void *blinkStatus);  // conmuta los leds con el estado de blink recibido como contexto
 
 };
 
@@ -7,15 +7,15 @@
 #define LIGHT_H
 
 #include "common.hpp"
+#include "event-bus.hpp"
+#include "state-machine.hpp"
 
-#include <Adafruit_NeoPixel.h>
+#include "neopixel-strip.hpp"
 #ifdef __AVR__
  #include <avr/power.h> // Required for 16 MHz Adafruit Trinket
 #endif
 
 
-#define TOTAL_PIXELS          39  // cada uno de los WS2811
-#define TOTAL_ZONES           3   // cada uno de los pisos
 #define MAX_BRIGHT            255
 #define ZERO_BRIGHT           0
 #define SCALER_SLOW_SPEED     130
@@ -28,7 +28,7 @@ class Light {
 public:
 
   // Define las posibles escenas o efectos de apagado o encendido
-  typedef enum {
+  typedef enum : uint8_t {
     NONE,
     SEQUENTIAL_ON,
     SEQUENTIAL_OFF,
@@ -39,40 +39,63 @@ public:
   } Scene;
 
   // Define los posibles estados
-  typedef enum {
+  typedef enum : uint8_t {
     ON,
     OFF
   } Status;
 
-  static void init(const uint8_t dataPin);
-  static void setAll(int red, int green, int blue);
-  static void on(void);
+  static void init(void);      // tira y zonas segun Station (una zona por piso); atiende Station::LIGHT_KEY
+  PROFILED static void setAll(int red, int green, int blue);
+  static void on(void);        // ambos publican LIGHT_SWITCHED (tambien el apagado automatico)
   static void off(void);
+  static uint8_t idle(void);   // 1 si no hay ninguna escena en curso
+  static Status status(void);
+  static uint8_t lit(void);    // 1 si status() es ON (incluso durante la escena de encendido)
+  static Scene scene(void);    // escena en curso (NONE al concluir)
+
+  /**
+   * Combinacion de escenas de encendido/apagado a utilizar (rotan con cada
+   * apagado); select retorna 0 si no existe
+   */
+  static uint8_t changeType(void);
+  static uint8_t select(uint8_t changeType);
 
 private:
 
-  // Define zonas, que son tramos iniciados por el nodo begin y finalizado por end
-  typedef struct { int begin; int end; } Zone;
+  friend struct TransitionTest;  // tablas de transiciones (test/test_state_machine)
 
   // Define un conjunto de escenas de apagado y encendido
   typedef struct { void (*on)(); void (*off)(); } ChangeType;
 
-  static Adafruit_NeoPixel *_pixels;
-  static Zone _zones[TOTAL_ZONES];
-  static Scene _scene;
-  static uint32_t _step;
+  static NeoPixelStrip<Station::PIXELS> _pixels;
+  static constexpr uint8_t SCENES = SEQUENTIAL_FADE_OFF + 1;
+
+  // Eventos: paso de la escena (el ultimo por separado) y seleccion de una escena (SELECT + escena)
+  enum : uint8_t {STEP, LAST_STEP, SELECT, EVENTS = SELECT + SCENES};
+
+  static const StateTransition _transitions[SCENES][EVENTS]; // escenas (en flash)
+  typedef StateMachine<SCENES, EVENTS, _transitions, LIGHT_MACHINE> Machine;
+  static Machine _machine;        // estado: escena en curso
+  static uint16_t _step;          // hasta 256 * Station::FLOORS (SEQUENTIAL_FADE_*)
   static uint8_t _intervalScalerCounter;
   static uint8_t _intervalScaler;
-  static ChangeType _changeTypes[];
+  static const ChangeType _changeTypes[];         // en flash
   static uint8_t _activeChangeType;
   static AsynchLoop::LoopId _autoOffInterval;
-  static long _onTimeSeconds;
+  static uint16_t _onTimeSeconds;
   static Status _status;
+  static const AsynchLoop::Task _tasks[];  // ciclo de escenas (en flash)
 
   static void _setIntervalScaler(uint8_t intervalScaler);
   static void _resetInterval(void);
-  static void _runInterval(void);
-  static void _setZone(uint8_t zone, int red, int green, int blue);
+  static void _runInterval(void *);
+  static void _sequentialOnStep(void);
+  static void _sequentialOffStep(void);
+  static void _fadeOnStep(void);
+  static void _fadeOffStep(void);
+  static void _sequentialFadeOnStep(void);
+  static void _sequentialFadeOffStep(void);
+  PROFILED static void _setZone(uint8_t zone, int red, int green, int blue);
   static void _on(void);
   static void _off(void);
   static void _sequentialOn(void);
@@ -82,6 +105,7 @@ private:
   static void _sequentialFadeOn(void);
   static void _sequentialFadeOff(void);
   static void _decreaseOnTimeSeconds(void);
+  static void _keyReleased(uint8_t key);
 
 };
 
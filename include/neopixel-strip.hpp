@@ -0,0 +1,39 @@
+/*
+ * neopixel-strip.hpp
+ * Copyright 2020 - Juan C. Bryksa (jcbryksa@gmail.com)
+ */
+
+#ifndef NEOPIXEL_STRIP_H
+#define NEOPIXEL_STRIP_H
+
+#include <Adafruit_NeoPixel.h>
+
+/*
+ * Tira de N leds RGB con el buffer de pixeles en memoria estatica.
+ * Adafruit_NeoPixel lo reserva con malloc() al recibir la cantidad de
+ * pixeles: aqui se construye vacia y se le asigna el buffer propio, por lo
+ * que su tamanio forma parte del .bss y no se usa el heap
+ */
+template <uint16_t N>
+class NeoPixelStrip : public Adafruit_NeoPixel {
+
+public:
+
+  NeoPixelStrip(neoPixelType type) : Adafruit_NeoPixel() {
+    updateType(type);          // sin buffer asignado no reserva memoria
+    pixels = _buffer;
+    numLEDs = N;
+    numBytes = sizeof(_buffer);
+  }
+
+  ~NeoPixelStrip() {
+    pixels = NULL;             // el destructor base no debe liberarlo
+  }
+
+private:
+
+  uint8_t _buffer[N * 3];
+
+};
+
+#endif
@@ -0,0 +1,64 @@
+/*
+ * power.hpp
+ * Copyright 2020 - Juan C. Bryksa (jcbryksa@gmail.com)
+ */
+
+#ifndef POWER_H
+#define POWER_H
+
+#include <avr/sleep.h>
+#include "common.hpp"
+#include "event-bus.hpp"
+
+/*
+ * Administrador de reposo: al final de cada loop() duerme el CPU hasta la
+ * proxima interrupcion
+ *  - SLEEP_MODE_IDLE mientras haya algun vencimiento programado o algun
+ *    modulo activo: el tick del AsynchLoop lo despierta (a lo sumo 1 ms)
+ *  - SLEEP_MODE_PWR_DOWN cuando nada depende del paso del tiempo: los
+ *    timers se detienen y solo lo despierta un cambio en los pines indicados
+ */
+class Power {
+
+public:
+
+  /**
+   * canPowerDown retorna 1 cuando ningun modulo necesita que el tiempo avance
+   * (ej. ascensor detenido, sin efectos ni escenas en curso)
+   */
+  static void init(uint8_t (*canPowerDown)(void));
+
+  /**
+   * Agrega un pin (tecla, final de carrera) cuyo cambio despierta del power-down
+   */
+  static void wakeOn(uint8_t pin);
+
+  /**
+   * Duerme hasta la proxima interrupcion (invocar al final de loop())
+   */
+  static void idle(void);
+
+  /**
+   * Porcentaje (en decimas) del tiempo en que el CPU estuvo activo desde la
+   * llamada anterior. El tiempo en power-down no se cuenta (el Timer0 de
+   * micros() tambien se detiene) y el ISR que despierta al CPU se cuenta
+   * como reposo
+   */
+  static uint16_t dutyCycle(void);
+
+  /**
+   * Cantidad de veces que se entro en power-down
+   */
+  static unsigned long powerDowns(void);
+
+private:
+
+  static uint8_t (*_canPowerDown)(void);
+  static uint8_t _pcicr;               // grupos de pin change de los pines registrados
+  static unsigned long _windowStart;   // micros() al comienzo de la medicion del duty cycle
+  static unsigned long _sleepMicros;   // tiempo dormido en modo idle desde entonces
+  static unsigned long _powerDowns;
+
+};
+
+#endif
@@ -0,0 +1,70 @@
+/*
+ * recorder.hpp
+ * Copyright 2020 - Juan C. Bryksa (jcbryksa@gmail.com)
+ */
+
+#ifndef RECORDER_H
+#define RECORDER_H
+
+#include <Arduino.h>
+
+// Registro de las entradas externas (teclas y finales de carrera) con el
+// tick del AsynchLoop en que se leyeron, para reproducirlas en el host
+// (replay/replay.cpp). 0: deshabilitado, sin codigo ni memoria
+#ifndef INPUT_RECORD
+#define INPUT_RECORD 0
+#endif
+
+#ifndef RECORD_BUFFER_SIZE
+#define RECORD_BUFFER_SIZE 16   // registros (potencia de 2, hasta 128), 6 bytes cada uno
+#endif
+
+#if INPUT_RECORD
+#define RECORD_INPUT(pin, level) Recorder::edge(pin, level)
+#else
+#define RECORD_INPUT(pin, level) (level)
+#endif
+
+#if INPUT_RECORD
+
+/*
+ * Solo se registran los cambios de nivel de cada pin; la primera lectura
+ * de cada uno fija su estado inicial. Las lineas ("I tick pin nivel") se
+ * envian desde loop() sin bloquear, a medida que hay lugar en el buffer
+ * de transmision
+ */
+class Recorder {
+
+public:
+
+  /**
+   * Registra la lectura de un pin si cambio su nivel y la retorna
+   * (se usa envolviendo a digitalRead)
+   */
+  static int edge(uint8_t pin, int level);
+
+  /**
+   * Envia los registros pendientes que entran en el buffer de transmision
+   */
+  static void flush(Print &out);
+
+private:
+
+  typedef struct {
+    unsigned long tick;
+    uint8_t pin;
+    uint8_t level;
+  } Record;
+
+  static Record _records[RECORD_BUFFER_SIZE];
+  static volatile uint8_t _head;     // registros escritos (modulo 256)
+  static uint8_t _tail;              // registros enviados (modulo 256)
+  static uint16_t _lost;             // descartados por buffer lleno
+  static uint32_t _known;            // pines ya leidos (bit por pin)
+  static uint32_t _levels;           // ultimo nivel de cada pin
+
+};
+
+#endif
+
+#endif
@@ -0,0 +1,93 @@
+/*
+ * state-machine.hpp
+ * Copyright 2020 - Juan C. Bryksa (jcbryksa@gmail.com)
+ */
+
+#ifndef STATE_MACHINE_H
+#define STATE_MACHINE_H
+
+#include "common.hpp"
+
+#define NO_TRANSITION 255                 // el evento se ignora en ese estado
+#define IGNORED       {NO_TRANSITION, NULL}
+
+// Maquina que registra cada cambio de estado (mismo orden en tools/trace2chrome.py)
+typedef enum : uint8_t {
+  ELEVATOR_MACHINE,     // estados: Elevator::Status
+  DISPLAY_MACHINE,      // Display::Effect
+  LIGHT_MACHINE         // Light::Scene
+} MachineId;
+
+// Transicion: estado siguiente y accion opcional (NULL: ninguna)
+typedef struct {
+  uint8_t next;
+  void (*action)(void);
+} StateTransition;
+
+/*
+ * Maquina de estados con la tabla de transiciones en flash, una fila por
+ * estado y una columna por evento. La tabla es un parametro del template,
+ * por lo que dispatch() se resuelve con un acceso a una direccion constante
+ * (O(1), sin recorrer condiciones) y la instancia solo ocupa el estado
+ * actual. La accion se ejecuta antes del cambio de estado (ve el estado de
+ * origen) y cada transicion atendida (no IGNORED, incluidas las que
+ * permanecen en el mismo estado) se registra en el Trace (TRANSITION).
+ *
+ *   enum : uint8_t {IDLE, RUNNING, STATES};    // estados
+ *   enum : uint8_t {START, STOP, EVENTS};      // eventos
+ *
+ *   const StateTransition table[STATES][EVENTS] PROGMEM = {
+ *     //             START              STOP
+ *     / * IDLE * /    {{RUNNING, begin}, IGNORED},
+ *     / * RUNNING * / {IGNORED,          {IDLE, end}},
+ *   };
+ *
+ *   StateMachine<STATES, EVENTS, table, ..._MACHINE> machine(IDLE);
+ *   machine.dispatch(START);
+ *
+ * No es reentrante: una accion no debe despachar eventos a su propia
+ * maquina, y todos los eventos de una maquina deben despacharse desde un
+ * mismo contexto (o con la maquina en un estado que el otro ignore)
+ */
+template <uint8_t STATES, uint8_t EVENTS, const StateTransition (&TABLE)[STATES][EVENTS], MachineId MACHINE>
+class StateMachine {
+
+  static_assert(STATES <= 16, "el Trace registra hasta 16 estados por maquina");
+
+public:
+
+  constexpr StateMachine(uint8_t initial = 0) : _state(initial) {}
+
+  uint8_t state(void) const {
+    return _state;
+  }
+
+  /**
+   * Ejecuta la transicion del estado actual para el evento
+   * Retorna 0 si el evento se ignora en ese estado
+   */
+  uint8_t dispatch(uint8_t event) {
+
+    const StateTransition *transition = &TABLE[_state][event];
+    uint8_t next = pgm_read_byte(&transition->next);
+
+    if ( next == NO_TRANSITION )
+      return 0;
+
+    void (*action)(void) = (void (*)(void)) pgm_read_ptr(&transition->action);
+    if ( action )
+      action();
+
+    _state = next;
+    TRACE(TRANSITION, (MACHINE << 4) | next);
+
+    return 1;
+  }
+
+private:
+
+  volatile uint8_t _state;
+
+};
+
+#endif
@@ -0,0 +1,73 @@
+/*
+ * station.hpp
+ * Copyright 2020 - Juan C. Bryksa (jcbryksa@gmail.com)
+ */
+
+#ifndef STATION_H
+#define STATION_H
+
+#include <Arduino.h>
+
+/*
+ * Descripcion unica de la estacion, resuelta en tiempo de compilacion: los
+ * modulos toman de aqui pines, cantidad de pisos y teclas y las zonas de la
+ * tira de leds, por lo que los limites de sus lazos y sus pines son
+ * constantes. Agregar un piso es agregar una linea a floors[]
+ */
+struct Station {
+
+  // Pines de cada piso (del primero al ultimo)
+  typedef struct {
+    uint8_t limitSwitch;    // final de carrera
+    uint8_t key;            // pulsador que solicita el piso
+  } Floor;
+
+  static constexpr Floor floors[] = {
+    {18, 17},
+    {19, 16},
+    { 6, 14},
+  };
+
+  static constexpr uint8_t FLOORS = sizeof(floors) / sizeof(floors[0]);
+
+  // Teclas: una por piso (numero de tecla = piso) y a continuacion la de las luces
+  static constexpr uint8_t LIGHT_KEY_PIN = 15;
+  static constexpr uint8_t LIGHT_KEY = FLOORS;
+  static constexpr uint8_t KEYS = FLOORS + 1;
+
+  static constexpr uint8_t keyPin(uint8_t key) {
+    return (key < FLOORS) ? floors[key].key : LIGHT_KEY_PIN;
+  }
+
+  // Display de 7 segmentos (a b c d e f g; el segmento f no esta conectado)
+  static constexpr uint8_t displayPins[7] = { 7, 8, 4, 3, 2, 99, 5 };
+  static constexpr uint8_t DISPLAY_COMMON = LOW;
+
+  // Leds indicadores (el primero acompania a la tecla de luces)
+  static constexpr uint8_t ledPins[] = { 11 };
+  static constexpr uint8_t LEDS = sizeof(ledPins);
+  static constexpr uint8_t LED_COMMON = HIGH;
+
+  // Motor del ascensor y buzzer
+  static constexpr uint8_t ENGINE_PIN_A = 9;    // sube
+  static constexpr uint8_t ENGINE_PIN_B = 10;   // baja
+  static constexpr uint8_t BUZZER_PIN = 13;
+
+  // Tira de leds WS2811: una zona de PIXELS_PER_FLOOR pixeles por piso
+  static constexpr uint8_t LIGHT_DATA_PIN = 12;
+  static constexpr uint8_t PIXELS_PER_FLOOR = 13;
+  static constexpr uint16_t PIXELS = FLOORS * PIXELS_PER_FLOOR;
+
+  static constexpr uint16_t zoneBegin(uint8_t floor) {
+    return floor * PIXELS_PER_FLOOR;
+  }
+
+  static constexpr uint16_t zoneEnd(uint8_t floor) {
+    return zoneBegin(floor) + PIXELS_PER_FLOOR - 1;
+  }
+
+};
+
+static_assert(Station::FLOORS >= 2 && Station::FLOORS <= 9, "el display muestra pisos del 1 al 9");
+
+#endif
@@ -0,0 +1,89 @@
+/*
+ * telemetry.hpp
+ * Copyright 2020 - Juan C. Bryksa (jcbryksa@gmail.com)
+ */
+
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <util/crc16.h>
+#include "common.hpp"
+
+// Canal binario de estado y comandos por Serial (tools/station-cli.py)
+// 0: deshabilitado, sin codigo ni memoria
+#ifndef TELEMETRY_ENABLED
+#define TELEMETRY_ENABLED 0
+#endif
+
+#define TELEMETRY_SYNC         0xA5
+#define TELEMETRY_MAX_PAYLOAD  12    // bytes de datos por trama
+#define TELEMETRY_TIMEOUT      50    // ms maximos entre bytes de una misma trama
+
+#if TELEMETRY_ENABLED
+
+/*
+ * Tramas: SYNC, largo de los datos, tipo, datos, CRC-8 (polinomio 0x07, de
+ * avr-libc) del largo, el tipo y los datos. Los bytes recibidos se procesan
+ * desde loop() a medida que llegan al buffer del USART (que los recibe por
+ * interrupcion) y una respuesta solo se encola si entra completa en el
+ * buffer de transmision: si no, se descarta y se cuenta, por lo que el
+ * canal nunca detiene al scheduler
+ */
+class Telemetry {
+
+public:
+
+  // Mantener los valores: tools/station-cli.py los usa por numero
+  typedef enum : uint8_t {
+    STATUS_REQUEST = 0x01,  // sin datos
+    GO_TO          = 0x02,  // piso (0 a Station::FLOORS - 1)
+    SET_LIGHT      = 0x03,  // 0 apaga, 1 enciende
+    SET_SCENE      = 0x04,  // combinacion de escenas de encendido/apagado
+    STATUS         = 0x81,  // respuesta a STATUS_REQUEST (ver _sendStatus)
+    ACK            = 0x82,  // comando aceptado (dato: tipo del comando)
+    NACK           = 0x83   // comando rechazado (datos: tipo del comando, motivo)
+  } Type;
+
+  // Motivos de NACK
+  typedef enum : uint8_t {
+    UNKNOWN_TYPE = 1,
+    BAD_LENGTH,
+    REJECTED                // el handler no pudo ejecutarlo (ej. ascensor ocupado)
+  } Reason;
+
+  /**
+   * command ejecuta GO_TO, SET_LIGHT y SET_SCENE con su dato; retorna 0 si lo rechaza
+   */
+  static void init(Stream &port, uint8_t (*command)(Type type, uint8_t value));
+
+  /**
+   * Procesa los bytes recibidos y responde (invocar continuamente desde loop())
+   */
+  static void poll(void);
+
+private:
+
+  typedef enum : uint8_t {WAIT_SYNC, WAIT_LENGTH, WAIT_TYPE, WAIT_DATA, WAIT_CRC} State;
+
+  static Stream *_port;
+  static uint8_t (*_command)(Type, uint8_t);
+  static State _state;
+  static uint8_t _length;
+  static uint8_t _type;
+  static uint8_t _received;          // datos recibidos de la trama en curso
+  static uint8_t _crc;
+  static uint8_t _payload[TELEMETRY_MAX_PAYLOAD];
+  static unsigned long _timestamp;   // millis() del ultimo byte recibido
+  static uint8_t _errors;            // tramas descartadas por CRC o largo (satura en 255)
+  static uint8_t _dropped;           // respuestas descartadas por buffer lleno (satura en 255)
+
+  static void _receive(uint8_t byte);
+  static void _execute(void);
+  static void _sendStatus(void);
+  static void _send(uint8_t type, const uint8_t *payload, uint8_t length);
+
+};
+
+#endif
+
+#endif
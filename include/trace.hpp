@@ -0,0 +1,82 @@
+/*
+ * trace.hpp
+ * Copyright 2020 - Juan C. Bryksa (jcbryksa@gmail.com)
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <Arduino.h>
+
+// Trazado de eventos en un buffer circular en RAM, volcado por Serial
+// (0: deshabilitado, sin codigo ni memoria; 1: eventos de la estacion;
+// 2: ademas el comienzo y fin de cada tick del AsynchLoop)
+#ifndef TRACE_ENABLED
+#define TRACE_ENABLED 0
+#endif
+
+#ifndef TRACE_BUFFER_SIZE
+#define TRACE_BUFFER_SIZE 32   // registros (potencia de 2, hasta 128), 6 bytes cada uno
+#endif
+
+#if TRACE_ENABLED
+#define TRACE(event, arg) Trace::record(Trace::event, arg)
+#else
+#define TRACE(event, arg)
+#endif
+
+#if TRACE_ENABLED
+
+/*
+ * Registra eventos con su timestamp (micros()) desde cualquier contexto.
+ * Al llenarse el buffer se sobrescriben los mas antiguos. El volcado es una
+ * linea por registro ("micros evento argumento") que tools/trace2chrome.py
+ * convierte al formato de Chrome trace / Perfetto
+ */
+class Trace {
+
+public:
+
+  // Mantener el orden: tools/trace2chrome.py identifica los eventos por numero
+  typedef enum : uint8_t {
+    KEY_RELEASED,       // tecla (arg: numero de tecla)
+    GO_TO,              // recorrido solicitado (arg: piso)
+    READY,              // fin de la espera previa al recorrido (arg: piso actual)
+    MOTOR_START,        // motor en marcha (arg: 1 sube, 2 baja)
+    LIMIT_SWITCH,       // cambio en los finales de carrera (arg: piso o NO_FLOOR)
+    BRAKE,              // comienzo del frenado (arg: sentido previo)
+    STOP,               // motor detenido (arg: piso)
+    DISPLAY_EFFECT,     // efecto del display (arg: Display::Effect)
+    LIGHT_FRAME,        // comienzo del envio a la tira (arg: Light::Scene)
+    LIGHT_FRAME_END,    // fin del envio (interrupciones deshabilitadas hasta aqui)
+    TICK_BEGIN,         // ISR del AsynchLoop (solo con TRACE_ENABLED 2)
+    TICK_END,
+    TRANSITION          // transicion atendida por una StateMachine (arg: maquina << 4 | estado siguiente)
+  } Event;
+
+  static void record(Event event, uint8_t arg = 0);
+
+  /**
+   * Vuelca los registros (del mas antiguo al mas reciente) y vacia el buffer
+   */
+  static void dump(Print &out);
+
+private:
+
+  typedef struct {
+    unsigned long time;
+    uint8_t event;
+    uint8_t arg;
+  } Record;
+
+  static Record _records[TRACE_BUFFER_SIZE];
+  static uint8_t _head;              // registros escritos (modulo 256)
+  static uint8_t _count;             // registros validos (hasta TRACE_BUFFER_SIZE)
+  static uint8_t _paused;            // 1 mientras se vuelca
+  static uint16_t _lost;             // sobrescritos o descartados desde el ultimo volcado
+
+};
+
+#endif
+
+#endif
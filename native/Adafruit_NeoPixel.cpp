@@ -0,0 +1,76 @@
+/*
+ * Adafruit_NeoPixel.cpp
+ * Copyright 2020 - Juan C. Bryksa (jcbryksa@gmail.com)
+ */
+
+#include <stdlib.h>
+
+#include "Adafruit_NeoPixel.h"
+#include "board.h"
+
+
+Adafruit_NeoPixel::Adafruit_NeoPixel(uint16_t n, int16_t p, neoPixelType) {
+  numLEDs = n;
+  numBytes = n * 3;
+  pin = p;
+  pixels = (uint8_t *) calloc(n, 3);
+}
+
+
+Adafruit_NeoPixel::Adafruit_NeoPixel() {
+  numLEDs = 0;
+  numBytes = 0;
+  pin = -1;
+  pixels = NULL;
+}
+
+
+Adafruit_NeoPixel::~Adafruit_NeoPixel() {
+  free(pixels);
+}
+
+
+void Adafruit_NeoPixel::begin() {
+  if ( pin >= 0 )
+    pinMode(pin, OUTPUT);
+}
+
+
+void Adafruit_NeoPixel::clear() {
+  memset(pixels, 0, numBytes);
+}
+
+
+void Adafruit_NeoPixel::show() {
+  Board::frame(pin, pixels, numLEDs);
+}
+
+
+void Adafruit_NeoPixel::setPin(int16_t p) {
+  pin = p;
+}
+
+
+void Adafruit_NeoPixel::updateType(neoPixelType) {
+}
+
+
+void Adafruit_NeoPixel::setPixelColor(uint16_t n, uint32_t color) {
+  if ( n >= numLEDs )
+    return;
+  pixels[n * 3]     = color >> 16;
+  pixels[n * 3 + 1] = color >> 8;
+  pixels[n * 3 + 2] = color;
+}
+
+
+uint32_t Adafruit_NeoPixel::getPixelColor(uint16_t n) const {
+  if ( n >= numLEDs )
+    return 0;
+  return Color(pixels[n * 3], pixels[n * 3 + 1], pixels[n * 3 + 2]);
+}
+
+
+uint16_t Adafruit_NeoPixel::numPixels() const {
+  return numLEDs;
+}
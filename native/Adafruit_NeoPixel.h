@@ -0,0 +1,49 @@
+/*
+ * Adafruit_NeoPixel.h
+ * Copyright 2020 - Juan C. Bryksa (jcbryksa@gmail.com)
+ *
+ * Tira de leds virtual: show() entrega los bytes de la tira a Board::frame()
+ */
+
+#ifndef NATIVE_ADAFRUIT_NEOPIXEL_H
+#define NATIVE_ADAFRUIT_NEOPIXEL_H
+
+#include <Arduino.h>
+
+#define NEO_GRB     0x52
+#define NEO_KHZ800  0x0000
+
+typedef uint16_t neoPixelType;
+
+// Mismos miembros protegidos que la biblioteca (ver NeoPixelStrip)
+class Adafruit_NeoPixel {
+
+public:
+
+  Adafruit_NeoPixel(uint16_t n, int16_t pin, neoPixelType type);
+  Adafruit_NeoPixel(void);
+  ~Adafruit_NeoPixel();
+
+  void begin(void);
+  void clear(void);
+  void show(void);
+  void setPin(int16_t pin);
+  void updateType(neoPixelType type);
+  void setPixelColor(uint16_t n, uint32_t color);
+  uint32_t getPixelColor(uint16_t n) const;
+  uint16_t numPixels(void) const;
+
+  static uint32_t Color(uint8_t r, uint8_t g, uint8_t b) {
+    return ((uint32_t) r << 16) | ((uint32_t) g << 8) | b;
+  }
+
+protected:
+
+  uint16_t numLEDs;
+  uint16_t numBytes;
+  int16_t pin;
+  uint8_t *pixels;                  // 3 bytes por pixel (r, g, b)
+
+};
+
+#endif
@@ -0,0 +1,67 @@
+/*
+ * HardwareSerial.cpp
+ * Copyright 2020 - Juan C. Bryksa (jcbryksa@gmail.com)
+ */
+
+#include <poll.h>
+#include <unistd.h>
+
+#include "HardwareSerial.h"
+
+HardwareSerial Serial;
+
+
+void HardwareSerial::attach(int fd) {
+  _fd = fd;
+  _peek = -1;
+}
+
+
+int HardwareSerial::available() {
+
+  if ( _peek >= 0 )
+    return 1;
+
+  if ( _fd < 0 )
+    return 0;
+
+  struct pollfd descriptor = { _fd, POLLIN, 0 };
+  uint8_t byte;
+
+  if ( poll(&descriptor, 1, 0) == 1 && (descriptor.revents & POLLIN) && ::read(_fd, &byte, 1) == 1 )
+    _peek = byte;
+
+  return _peek >= 0;
+}
+
+
+int HardwareSerial::read() {
+
+  if ( ! available() )
+    return -1;
+
+  int byte = _peek;
+  _peek = -1;
+
+  return byte;
+}
+
+
+int HardwareSerial::availableForWrite() {
+
+  if ( _fd < 0 )
+    return SERIAL_TX_BUFFER_SIZE - 1;
+
+  struct pollfd descriptor = { _fd, POLLOUT, 0 };
+
+  return ( poll(&descriptor, 1, 0) == 1 && (descriptor.revents & POLLOUT) ) ? SERIAL_TX_BUFFER_SIZE - 1 : 0;
+}
+
+
+size_t HardwareSerial::write(uint8_t byte) {
+
+  if ( _fd < 0 )
+    return 1;
+
+  return ::write(_fd, &byte, 1) == 1;
+}
@@ -0,0 +1,48 @@
+/*
+ * HardwareSerial.h
+ * Copyright 2020 - Juan C. Bryksa (jcbryksa@gmail.com)
+ *
+ * Serial del host: sin descriptor conectado descarta la salida; con
+ * attach() lee y escribe sin bloquear en un pty o socket (ej. el que abre
+ * replay --serial para tools/station-cli.py)
+ */
+
+#ifndef NATIVE_HARDWARE_SERIAL_H
+#define NATIVE_HARDWARE_SERIAL_H
+
+#include "Print.h"
+
+#define SERIAL_TX_BUFFER_SIZE 64   // igual que el core para el ATmega328P
+
+class Stream : public Print {
+
+public:
+
+  virtual int available(void) = 0;
+  virtual int read(void) = 0;
+
+};
+
+class HardwareSerial : public Stream {
+
+public:
+
+  void begin(unsigned long baud) { (void) baud; }
+  void attach(int fd);
+
+  int available(void);
+  int read(void);
+  int availableForWrite(void);
+  size_t write(uint8_t byte);
+  using Print::write;
+
+private:
+
+  int _fd = -1;
+  int _peek = -1;                  // byte leido por available() aun no entregado
+
+};
+
+extern HardwareSerial Serial;
+
+#endif
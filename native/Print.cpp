@@ -0,0 +1,64 @@
+/*
+ * Print.cpp
+ * Copyright 2020 - Juan C. Bryksa (jcbryksa@gmail.com)
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "Print.h"
+
+
+size_t Print::write(const uint8_t *buffer, size_t size) {
+
+  size_t n = 0;
+  while ( size-- && write(*buffer++) )
+    n++;
+
+  return n;
+}
+
+
+size_t Print::print(const __FlashStringHelper *string) {
+  return print(reinterpret_cast<const char *>(string));
+}
+
+
+size_t Print::print(const char *string) {
+  return write((const uint8_t *) string, strlen(string));
+}
+
+
+size_t Print::print(char c) {
+  return write((uint8_t) c);
+}
+
+
+size_t Print::print(long n, int base) {
+
+  if ( base != DEC )
+    return print((unsigned long) n, base);
+
+  char buffer[24];
+  snprintf(buffer, sizeof(buffer), "%ld", n);
+  return print(buffer);
+}
+
+
+size_t Print::print(unsigned long n, int base) {
+  char buffer[24];
+  snprintf(buffer, sizeof(buffer), (base == HEX) ? "%lX" : "%lu", n);
+  return print(buffer);
+}
+
+
+size_t Print::print(double n, int digits) {
+  char buffer[48];
+  snprintf(buffer, sizeof(buffer), "%.*f", digits, n);
+  return print(buffer);
+}
+
+
+size_t Print::println() {
+  return print("\r\n");
+}
@@ -0,0 +1,46 @@
+/*
+ * Print.h
+ * Copyright 2020 - Juan C. Bryksa (jcbryksa@gmail.com)
+ *
+ * Subconjunto de Print del core de Arduino (enteros en decimal o hexadecimal)
+ */
+
+#ifndef NATIVE_PRINT_H
+#define NATIVE_PRINT_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define DEC 10
+#define HEX 16
+
+class __FlashStringHelper;
+#define F(string) (reinterpret_cast<const __FlashStringHelper *>(string))
+
+class Print {
+
+public:
+
+  virtual ~Print() {}
+
+  virtual size_t write(uint8_t byte) = 0;
+  virtual size_t write(const uint8_t *buffer, size_t size);
+  virtual int availableForWrite(void) { return 0; }
+
+  size_t print(const __FlashStringHelper *string);
+  size_t print(const char *string);
+  size_t print(char c);
+  size_t print(long n, int base = DEC);
+  size_t print(unsigned long n, int base = DEC);
+  size_t print(int n, int base = DEC) { return print((long) n, base); }
+  size_t print(unsigned int n, int base = DEC) { return print((unsigned long) n, base); }
+  size_t print(unsigned char n, int base = DEC) { return print((unsigned long) n, base); }
+  size_t print(double n, int digits = 2);
+
+  size_t println(void);
+  template <typename T> size_t println(T value) { return print(value) + println(); }
+  template <typename T> size_t println(T value, int format) { return print(value, format) + println(); }
+
+};
+
+#endif
@@ -0,0 +1,39 @@
+/*
+ * avr/eeprom.h
+ * Copyright 2020 - Juan C. Bryksa (jcbryksa@gmail.com)
+ *
+ * EEPROM del host: 1 KB en RAM (borrada, 0xFF, en cada ejecucion) y
+ * siempre lista para escribir
+ */
+
+#ifndef NATIVE_AVR_EEPROM_H
+#define NATIVE_AVR_EEPROM_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define E2END 0x3FF
+
+extern uint8_t __eeprom[E2END + 1];
+
+#define eeprom_is_ready() 1
+
+static inline uint8_t eeprom_read_byte(const uint8_t *address) {
+  return __eeprom[(uintptr_t) address & E2END];
+}
+
+static inline void eeprom_update_byte(uint8_t *address, uint8_t value) {
+  __eeprom[(uintptr_t) address & E2END] = value;
+}
+
+static inline void eeprom_read_block(void *destination, const void *source, size_t size) {
+  for ( size_t i = 0 ; i < size ; i++ )
+    ((uint8_t *) destination)[i] = eeprom_read_byte((const uint8_t *) source + i);
+}
+
+static inline void eeprom_update_block(const void *source, void *destination, size_t size) {
+  for ( size_t i = 0 ; i < size ; i++ )
+    eeprom_update_byte((uint8_t *) destination + i, ((const uint8_t *) source)[i]);
+}
+
+#endif
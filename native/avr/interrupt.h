@@ -0,0 +1,20 @@
+/*
+ * avr/interrupt.h
+ * Copyright 2020 - Juan C. Bryksa (jcbryksa@gmail.com)
+ *
+ * En el host los vectores son funciones comunes (ej. TIMER1_OVF_vect())
+ * y cli()/sei() solo modifican el bit I del SREG simulado
+ */
+
+#ifndef NATIVE_AVR_INTERRUPT_H
+#define NATIVE_AVR_INTERRUPT_H
+
+#include <avr/io.h>
+
+#define ISR(vector) extern "C" void vector(void)
+#define EMPTY_INTERRUPT(vector) extern "C" void vector(void) {}
+
+inline void cli() { SREG &= ~0x80; }
+inline void sei() { SREG |= 0x80; }
+
+#endif
@@ -0,0 +1,20 @@
+/*
+ * avr/sleep.h
+ * Copyright 2020 - Juan C. Bryksa (jcbryksa@gmail.com)
+ *
+ * En el host el CPU nunca duerme: sleep_cpu() retorna de inmediato
+ */
+
+#ifndef NATIVE_AVR_SLEEP_H
+#define NATIVE_AVR_SLEEP_H
+
+#define SLEEP_MODE_IDLE      0
+#define SLEEP_MODE_PWR_SAVE  3
+#define SLEEP_MODE_PWR_DOWN  2
+
+#define set_sleep_mode(mode) ((void) (mode))
+#define sleep_enable()
+#define sleep_disable()
+#define sleep_cpu()
+
+#endif
@@ -0,0 +1,99 @@
+/*
+ * board.cpp
+ * Copyright 2020 - Juan C. Bryksa (jcbryksa@gmail.com)
+ *
+ * Implementa tambien las funciones del core de Arduino sobre la placa virtual
+ */
+
+#include "board.h"
+
+// Sin nada conectado las entradas leen HIGH (pull-ups de teclas y finales de carrera)
+uint8_t Board::_modes[NUM_DIGITAL_PINS];
+uint8_t Board::_inputs[NUM_DIGITAL_PINS] = {
+  HIGH, HIGH, HIGH, HIGH, HIGH, HIGH, HIGH, HIGH, HIGH, HIGH, HIGH,
+  HIGH, HIGH, HIGH, HIGH, HIGH, HIGH, HIGH, HIGH, HIGH, HIGH, HIGH
+};
+int Board::_outputs[NUM_DIGITAL_PINS];
+unsigned long Board::_micros = 0;
+
+void (*Board::onOutput)(uint8_t, int, uint8_t) = NULL;
+void (*Board::onFrame)(uint8_t, const uint8_t *, uint16_t) = NULL;
+
+
+void Board::input(uint8_t pin, uint8_t level) {
+  if ( pin < NUM_DIGITAL_PINS )
+    _inputs[pin] = level ? HIGH : LOW;
+}
+
+
+int Board::output(uint8_t pin) {
+  return ( pin < NUM_DIGITAL_PINS ) ? _outputs[pin] : 0;
+}
+
+
+unsigned long Board::now() {
+  return _micros;
+}
+
+
+void Board::advance(unsigned long micros) {
+  _micros += micros;
+}
+
+
+void Board::frame(uint8_t pin, const uint8_t *pixels, uint16_t count) {
+  if ( onFrame )
+    onFrame(pin, pixels, count);
+}
+
+
+void Board::_write(uint8_t pin, int value, uint8_t analog) {
+
+  // Pines inexistentes (ej. segmento sin conectar) se ignoran
+  if ( pin >= NUM_DIGITAL_PINS || _outputs[pin] == value )
+    return;
+
+  _outputs[pin] = value;
+
+  if ( onOutput )
+    onOutput(pin, value, analog);
+}
+
+
+void pinMode(uint8_t pin, uint8_t mode) {
+  if ( pin < NUM_DIGITAL_PINS )
+    Board::_modes[pin] = mode;
+}
+
+
+void digitalWrite(uint8_t pin, uint8_t value) {
+  Board::_write(pin, value ? HIGH : LOW, 0);
+}
+
+
+int digitalRead(uint8_t pin) {
+
+  if ( pin >= NUM_DIGITAL_PINS )
+    return LOW;
+
+  // Un pin de salida lee su propio nivel (ej. el buzzer, que se invierte)
+  if ( Board::_modes[pin] == OUTPUT )
+    return Board::_outputs[pin] ? HIGH : LOW;
+
+  return Board::_inputs[pin];
+}
+
+
+void analogWrite(uint8_t pin, int value) {
+  Board::_write(pin, value, 1);
+}
+
+
+unsigned long millis() {
+  return Board::now() / 1000;
+}
+
+
+unsigned long micros() {
+  return Board::now();
+}
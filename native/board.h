@@ -0,0 +1,59 @@
+/*
+ * board.h
+ * Copyright 2020 - Juan C. Bryksa (jcbryksa@gmail.com)
+ *
+ * Placa virtual del host: niveles de los pines, reloj (micros) y avisos
+ * de cada salida, que el programa del host controla u observa
+ */
+
+#ifndef NATIVE_BOARD_H
+#define NATIVE_BOARD_H
+
+#include <Arduino.h>
+
+class Board {
+
+public:
+
+  /**
+   * Fija el nivel externo de un pin de entrada (tecla o final de carrera)
+   */
+  static void input(uint8_t pin, uint8_t level);
+
+  /**
+   * Ultimo valor escrito en un pin de salida (digital o PWM)
+   */
+  static int output(uint8_t pin);
+
+  /**
+   * Reloj virtual en microsegundos (base de millis() y micros())
+   */
+  static unsigned long now(void);
+  static void advance(unsigned long micros);
+
+  /**
+   * Invocada por Adafruit_NeoPixel::show() con los bytes de la tira
+   */
+  static void frame(uint8_t pin, const uint8_t *pixels, uint16_t count);
+
+  // Avisos de cambios en las salidas (analog: 1 si fue escrita con analogWrite)
+  static void (*onOutput)(uint8_t pin, int value, uint8_t analog);
+  static void (*onFrame)(uint8_t pin, const uint8_t *pixels, uint16_t count);
+
+private:
+
+  friend void pinMode(uint8_t, uint8_t);
+  friend void digitalWrite(uint8_t, uint8_t);
+  friend int digitalRead(uint8_t);
+  friend void analogWrite(uint8_t, int);
+
+  static void _write(uint8_t pin, int value, uint8_t analog);
+
+  static uint8_t _modes[NUM_DIGITAL_PINS];
+  static uint8_t _inputs[NUM_DIGITAL_PINS];
+  static int _outputs[NUM_DIGITAL_PINS];
+  static unsigned long _micros;
+
+};
+
+#endif
@@ -0,0 +1,22 @@
+/*
+ * registers.cpp
+ * Copyright 2020 - Juan C. Bryksa (jcbryksa@gmail.com)
+ */
+
+#include <string.h>
+#include <avr/io.h>
+#include <avr/eeprom.h>
+
+volatile uint8_t SREG = 0x80;
+volatile uint8_t GTCCR;
+
+volatile uint8_t TCCR0A, TCCR0B, TCNT0, OCR0A, OCR0B, TIMSK0, TIFR0;
+volatile uint8_t TCCR1A, TCCR1B, TIMSK1, TIFR1;
+volatile uint16_t TCNT1, ICR1, OCR1A, OCR1B;
+volatile uint8_t TCCR2A, TCCR2B, TCNT2, OCR2A, OCR2B, TIMSK2, TIFR2;
+volatile uint8_t PCICR, PCIFR, PCMSK0, PCMSK1, PCMSK2;
+
+uint8_t __eeprom[E2END + 1];
+
+// La EEPROM se entrega borrada, como de fabrica
+static struct EepromInit { EepromInit() { memset(__eeprom, 0xFF, sizeof(__eeprom)); } } eepromInit;
@@ -0,0 +1,23 @@
+/*
+ * util/crc16.h
+ * Copyright 2020 - Juan C. Bryksa (jcbryksa@gmail.com)
+ *
+ * Misma definicion que avr-libc (polinomio x^8 + x^2 + x + 1)
+ */
+
+#ifndef NATIVE_UTIL_CRC16_H
+#define NATIVE_UTIL_CRC16_H
+
+#include <stdint.h>
+
+static inline uint8_t _crc8_ccitt_update(uint8_t crc, uint8_t data) {
+
+  crc ^= data;
+
+  for ( uint8_t i = 0 ; i < 8 ; i++ )
+    crc = (crc & 0x80) ? (uint8_t) ((crc << 1) ^ 0x07) : (uint8_t) (crc << 1);
+
+  return crc;
+}
+
+#endif
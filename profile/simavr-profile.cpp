@@ -0,0 +1,215 @@
+/*
+ * simavr-profile.cpp
+ * Copyright 2020 - Juan C. Bryksa (jcbryksa@gmail.com)
+ *
+ * Ejecuta la imagen real del firmware (ELF para el ATmega328P) en simavr,
+ * aplica una sesion de entradas ("I tick pin nivel", el formato del
+ * Recorder) y mide ciclo a ciclo:
+ *  - cada invocacion de las funciones indicadas (ciclos inclusivos, con
+ *    las interrupciones que las interrumpan y las funciones que invoquen)
+ *  - la ventana mas larga con las interrupciones deshabilitadas
+ *
+ *   simavr-profile firmware.elf sesion.txt ms nombre=0xdireccion ...
+ *
+ * Normalmente lo invoca tools/avr-profile.py, que obtiene las direcciones
+ * con avr-nm, interpreta el resultado (JSON por stdout) y, si existe, lo
+ * compara con la referencia aprobada (profile/baseline.json).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include <simavr/sim_avr.h>
+#include <simavr/sim_elf.h>
+#include <simavr/avr_ioport.h>
+
+#define F_CPU        16000000UL
+#define CYCLES_PER_MS (F_CPU / 1000)
+
+typedef struct {
+  unsigned long tick;
+  uint8_t pin;
+  uint8_t level;
+} Input;
+
+typedef struct {
+  const char *name;
+  uint32_t address;                // direccion en bytes (como la informa avr-nm)
+  unsigned long calls;
+  avr_cycle_count_t total;
+  avr_cycle_count_t min;
+  avr_cycle_count_t max;
+} Function;
+
+typedef struct {
+  size_t function;
+  uint16_t sp;                     // SP luego de apilar la direccion de retorno
+  avr_cycle_count_t start;
+} Frame;
+
+
+/*
+ * Puerto y bit de cada pin del Nano: D0-D7 PORTD, D8-D13 PORTB, A0-A5 PORTC
+ */
+static int pinPort(uint8_t pin, char *port, uint8_t *bit) {
+  if ( pin <= 7 )       { *port = 'D'; *bit = pin; }
+  else if ( pin <= 13 ) { *port = 'B'; *bit = pin - 8; }
+  else if ( pin <= 19 ) { *port = 'C'; *bit = pin - 14; }
+  else
+    return 0;
+  return 1;
+}
+
+
+static int readSession(const char *path, std::vector<Input> &inputs) {
+
+  FILE *file = fopen(path, "r");
+  if ( ! file ) {
+    perror(path);
+    return 0;
+  }
+
+  char line[128];
+  while ( fgets(line, sizeof(line), file) ) {
+    Input input;
+    unsigned int pin, level;
+    if ( sscanf(line, "I %lu %u %u", &input.tick, &pin, &level) == 3 ) {
+      input.pin = pin;
+      input.level = level;
+      inputs.push_back(input);
+    }
+  }
+
+  fclose(file);
+  return 1;
+}
+
+
+static uint16_t stackPointer(avr_t *avr) {
+  return avr->data[R_SPL] | (avr->data[R_SPH] << 8);
+}
+
+
+int main(int argc, char *argv[]) {
+
+  if ( argc < 4 ) {
+    fprintf(stderr, "uso: %s firmware.elf sesion.txt ms [nombre=0xdireccion ...]\n", argv[0]);
+    return 2;
+  }
+
+  std::vector<Input> inputs;
+  if ( ! readSession(argv[2], inputs) )
+    return 2;
+
+  avr_cycle_count_t end = strtoul(argv[3], NULL, 10) * CYCLES_PER_MS;
+
+  std::vector<Function> functions;
+  for ( int i = 4 ; i < argc ; i++ ) {
+    char *separator = strrchr(argv[i], '=');
+    if ( ! separator )
+      continue;
+    *separator = 0;
+    Function function = { argv[i], (uint32_t) strtoul(separator + 1, NULL, 0), 0, 0, (avr_cycle_count_t) -1, 0 };
+    functions.push_back(function);
+  }
+
+  elf_firmware_t firmware;
+  memset(&firmware, 0, sizeof(firmware));
+  if ( elf_read_firmware(argv[1], &firmware) ) {
+    fprintf(stderr, "%s: no se pudo leer el firmware\n", argv[1]);
+    return 2;
+  }
+
+  avr_t *avr = avr_make_mcu_by_name("atmega328p");
+  if ( ! avr ) {
+    fprintf(stderr, "simavr sin soporte para atmega328p\n");
+    return 2;
+  }
+
+  avr_init(avr);
+  avr->frequency = F_CPU;
+  avr->log = LOG_ERROR;
+  avr_load_firmware(avr, &firmware);
+
+  std::vector<Frame> frames;
+  size_t next = 0;
+
+  avr_cycle_count_t irqOffStart = 0, irqOffMax = 0;
+  uint32_t irqOffPc = 0, irqOffStartPc = 0;
+  uint8_t irqOff = 0;
+  unsigned long lostFrames = 0;
+
+  while ( avr->cycle < end ) {
+
+    // Entradas de la sesion (el tick del Recorder equivale a 1 ms)
+    while ( next < inputs.size() && inputs[next].tick * CYCLES_PER_MS <= avr->cycle ) {
+      char port;
+      uint8_t bit;
+      if ( pinPort(inputs[next].pin, &port, &bit) )
+        avr_raise_irq(avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ(port), bit), inputs[next].level);
+      next++;
+    }
+
+    uint16_t sp = stackPointer(avr);
+
+    // Retornos: el SP supera al de la entrada de la funcion
+    while ( ! frames.empty() && sp > frames.back().sp ) {
+      Frame &frame = frames.back();
+      Function &function = functions[frame.function];
+      avr_cycle_count_t cycles = avr->cycle - frame.start;
+      function.calls++;
+      function.total += cycles;
+      if ( cycles < function.min )
+        function.min = cycles;
+      if ( cycles > function.max )
+        function.max = cycles;
+      frames.pop_back();
+    }
+
+    // Entradas (la instruccion siguiente a la llamada es la primera de la funcion)
+    for ( size_t i = 0 ; i < functions.size() ; i++ )
+      if ( avr->pc == functions[i].address ) {
+        if ( frames.size() < 64 ) {
+          Frame frame = { i, sp, avr->cycle };
+          frames.push_back(frame);
+        }
+        else
+          lostFrames++;
+      }
+
+    // Ventana con las interrupciones deshabilitadas
+    if ( ! avr->sreg[S_I] && ! irqOff ) {
+      irqOff = 1;
+      irqOffStart = avr->cycle;
+      irqOffStartPc = avr->pc;
+    }
+    else if ( avr->sreg[S_I] && irqOff ) {
+      irqOff = 0;
+      if ( avr->cycle - irqOffStart > irqOffMax ) {
+        irqOffMax = avr->cycle - irqOffStart;
+        irqOffPc = irqOffStartPc;
+      }
+    }
+
+    int state = avr_run(avr);
+    if ( state == cpu_Done || state == cpu_Crashed ) {
+      fprintf(stderr, "el firmware se detuvo (estado %d, pc 0x%04x)\n", state, avr->pc);
+      return 1;
+    }
+  }
+
+  // Resultado en JSON (lo interpreta tools/avr-profile.py)
+  printf("{\n  \"cycles\": %llu,\n  \"functions\": {\n", (unsigned long long) avr->cycle);
+  for ( size_t i = 0 ; i < functions.size() ; i++ ) {
+    const Function &f = functions[i];
+    printf("    \"%s\": {\"calls\": %lu, \"min\": %llu, \"mean\": %.1f, \"max\": %llu}%s\n", f.name, f.calls,
+           (unsigned long long) (f.calls ? f.min : 0), f.calls ? (double) f.total / f.calls : 0.0,
+           (unsigned long long) f.max, (i + 1 < functions.size()) ? "," : "");
+  }
+  printf("  },\n  \"irq_off\": {\"max\": %llu, \"pc\": %u},\n  \"lost_frames\": %lu\n}\n",
+         (unsigned long long) irqOffMax, irqOffPc, lostFrames);
+
+  return 0;
+}
@@ -0,0 +1,368 @@
+/*
+ * replay.cpp
+ * Copyright 2020 - Juan C. Bryksa (jcbryksa@gmail.com)
+ *
+ * Reproduce en el host una sesion de entradas registrada en la placa
+ * (firmware compilado con -DINPUT_RECORD=1, lineas "I tick pin nivel") y
+ * emite la linea de tiempo de las salidas: motor, buzzer, segmentos,
+ * indicadores y cuadros de la tira de leds.
+ *
+ *   pio run -e replay
+ *   .pio/build/replay/program sesion.txt > esperado.txt
+ *   .pio/build/replay/program sesion.txt --expect esperado.txt [--tolerance ticks]
+ *
+ * Cada tick aplica las entradas de ese tick, invoca el vector del timer
+ * del AsynchLoop y luego loop() una vez. La salida es una linea por cambio
+ * ("tick D|A pin valor" para digitalWrite/analogWrite y "tick F pin hash"
+ * para cada show() de la tira). Con --expect compara contra una linea de
+ * tiempo anterior: informa la primera divergencia de comportamiento y el
+ * primer y mayor corrimiento de latencia, y retorna 1 si hubo diferencias.
+ *
+ * Con --serial conecta Serial a un pseudo terminal (informa su nombre) y
+ * avanza en tiempo real hasta --ticks o indefinidamente, para probar el
+ * canal de telemetria (-DTELEMETRY_ENABLED=1) con tools/station-cli.py.
+ *
+ * replay/sessions/ guarda sesiones de referencia (nombre.txt) junto con su
+ * linea de tiempo aprobada (nombre.expected.txt), que compara
+ * tools/replay-check.py; un cambio deliberado de comportamiento se acompana
+ * con la linea de tiempo regenerada (tools/replay-check.py --update).
+ *
+ * Con --eeprom la EEPROM se carga del archivo indicado (si existe) y se
+ * guarda al terminar, para encadenar arranques (ej. un corte a mitad de
+ * un recorrido) y verificar lo que restaura el Journal.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <time.h>
+#include <vector>
+
+#include <Arduino.h>
+#include "board.h"
+#include <avr/eeprom.h>
+#include "async-loop.hpp"
+
+#if ASYNC_LOOP_ABSOLUTE
+#error "la reproduccion simula un tick fijo por interrupcion"
+#endif
+
+#if ASYNC_LOOP_TIMER == 0
+#define TICK_VECTOR TIMER0_COMPB_vect
+#define TICK_MICROS TIMER0_TICK_MICROS
+#elif ASYNC_LOOP_TIMER == 1
+#define TICK_VECTOR TIMER1_OVF_vect
+#define TICK_MICROS 1000UL
+#else
+#define TICK_VECTOR TIMER2_COMPA_vect
+#define TICK_MICROS 1000UL
+#endif
+
+extern "C" void TICK_VECTOR(void);
+
+#define SETTLE_TICKS 20000UL       // ticks simulados luego de la ultima entrada
+
+typedef struct {
+  unsigned long tick;
+  uint8_t pin;
+  uint8_t level;
+} Input;
+
+typedef struct {
+  unsigned long tick;
+  char kind;                       // 'D' digital, 'A' PWM, 'F' cuadro de la tira
+  unsigned int pin;
+  unsigned long value;
+} Change;
+
+static std::vector<Input> inputs;
+static std::vector<Change> timeline;
+static unsigned long tick = 0;
+
+
+static void onOutput(uint8_t pin, int value, uint8_t analog) {
+  Change change = { tick, (char) (analog ? 'A' : 'D'), pin, (unsigned long) value };
+  timeline.push_back(change);
+}
+
+
+static void onFrame(uint8_t pin, const uint8_t *pixels, uint16_t count) {
+
+  // FNV-1a de los bytes de la tira
+  uint32_t hash = 2166136261UL;
+  for ( uint16_t i = 0 ; i < count * 3 ; i++ ) {
+    hash ^= pixels[i];
+    hash *= 16777619UL;
+  }
+
+  Change change = { tick, 'F', pin, hash };
+  timeline.push_back(change);
+}
+
+
+static void print(FILE *out, const Change &change) {
+  if ( change.kind == 'F' )
+    fprintf(out, "%lu F %u %08lx\n", change.tick, change.pin, change.value);
+  else
+    fprintf(out, "%lu %c %u %lu\n", change.tick, change.kind, change.pin, change.value);
+}
+
+
+static int readSession(const char *path) {
+
+  FILE *file = fopen(path, "r");
+  if ( ! file ) {
+    perror(path);
+    return 0;
+  }
+
+  char line[128];
+  while ( fgets(line, sizeof(line), file) ) {
+
+    Input input;
+    unsigned long lost;
+    unsigned int pin, level;
+
+    // Se ignora el resto de la salida por Serial (trace, perfilado)
+    if ( sscanf(line, "I %lu %u %u", &input.tick, &pin, &level) == 3 ) {
+      input.pin = pin;
+      input.level = level;
+      inputs.push_back(input);
+    }
+    else if ( sscanf(line, "lost %lu", &lost) == 1 )
+      fprintf(stderr, "aviso: la sesion perdio %lu registros, la reproduccion no es exacta\n", lost);
+  }
+
+  fclose(file);
+  return 1;
+}
+
+
+/*
+ * Abre un pseudo terminal para Serial y retorna 0 si no pudo
+ */
+static int openSerial() {
+
+  int fd = posix_openpt(O_RDWR | O_NOCTTY);
+
+  if ( fd < 0 || grantpt(fd) || unlockpt(fd) ) {
+    perror("pty");
+    return 0;
+  }
+
+  fprintf(stderr, "Serial en %s\n", ptsname(fd));
+  Serial.attach(fd);
+
+  return 1;
+}
+
+
+/*
+ * Espera hasta que el reloj del host alcance el tick virtual
+ */
+static void pace(const struct timespec &start) {
+
+  unsigned long long micros = (unsigned long long) tick * TICK_MICROS;
+  struct timespec deadline = start;
+
+  deadline.tv_sec += micros / 1000000;
+  deadline.tv_nsec += (micros % 1000000) * 1000;
+  if ( deadline.tv_nsec >= 1000000000L ) {
+    deadline.tv_sec++;
+    deadline.tv_nsec -= 1000000000L;
+  }
+
+  while ( clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL) )
+    ;
+}
+
+
+static int readTimeline(const char *path, std::vector<Change> &changes) {
+
+  FILE *file = fopen(path, "r");
+  if ( ! file ) {
+    perror(path);
+    return 0;
+  }
+
+  char line[128];
+  while ( fgets(line, sizeof(line), file) ) {
+
+    Change change;
+    char kind;
+
+    if ( sscanf(line, "%lu %c %u", &change.tick, &kind, &change.pin) != 3 )
+      continue;
+
+    change.kind = kind;
+    const char *format = (kind == 'F') ? "%*lu %*c %*u %lx" : "%*lu %*c %*u %lu";
+    if ( sscanf(line, format, &change.value) != 1 )
+      continue;
+
+    changes.push_back(change);
+  }
+
+  fclose(file);
+  return 1;
+}
+
+
+/*
+ * Compara el orden y los valores de los cambios; los ticks solo se comparan
+ * como corrimiento de latencia, con la tolerancia indicada
+ */
+static int compare(const std::vector<Change> &expected, unsigned long tolerance) {
+
+  size_t common = (expected.size() < timeline.size()) ? expected.size() : timeline.size();
+  size_t i;
+  long firstShift = 0, maxShift = 0;
+  size_t firstShiftIndex = 0, maxShiftIndex = 0;
+
+  for ( i = 0 ; i < common ; i++ ) {
+
+    const Change &e = expected[i];
+    const Change &a = timeline[i];
+
+    if ( e.kind != a.kind || e.pin != a.pin || e.value != a.value )
+      break;
+
+    long shift = (long) (a.tick - e.tick);
+    if ( shift && ! firstShift ) {
+      firstShift = shift;
+      firstShiftIndex = i;
+    }
+    if ( labs(shift) > labs(maxShift) ) {
+      maxShift = shift;
+      maxShiftIndex = i;
+    }
+  }
+
+  int failed = 0;
+
+  if ( i < common || expected.size() != timeline.size() ) {
+    failed = 1;
+    fprintf(stderr, "divergencia en el cambio %zu\n", i);
+    fprintf(stderr, "  esperado: ");
+    if ( i < expected.size() )
+      print(stderr, expected[i]);
+    else
+      fprintf(stderr, "(fin)\n");
+    fprintf(stderr, "  obtenido: ");
+    if ( i < timeline.size() )
+      print(stderr, timeline[i]);
+    else
+      fprintf(stderr, "(fin)\n");
+  }
+
+  if ( firstShift ) {
+    fprintf(stderr, "primer corrimiento: %+ld ticks en el cambio %zu (tick esperado %lu)\n",
+            firstShift, firstShiftIndex, expected[firstShiftIndex].tick);
+    fprintf(stderr, "mayor corrimiento:  %+ld ticks en el cambio %zu (tick esperado %lu)\n",
+            maxShift, maxShiftIndex, expected[maxShiftIndex].tick);
+    if ( (unsigned long) labs(maxShift) > tolerance )
+      failed = 1;
+  }
+
+  if ( ! failed )
+    fprintf(stderr, "sin diferencias (%zu cambios)\n", timeline.size());
+
+  return failed;
+}
+
+
+int main(int argc, char *argv[]) {
+
+  const char *session = NULL;
+  const char *expect = NULL;
+  unsigned long ticks = 0;
+  unsigned long tolerance = 0;
+  int serial = 0;
+  const char *eeprom = NULL;
+
+  for ( int i = 1 ; i < argc ; i++ ) {
+    if ( ! strcmp(argv[i], "--expect") && i + 1 < argc )
+      expect = argv[++i];
+    else if ( ! strcmp(argv[i], "--ticks") && i + 1 < argc )
+      ticks = strtoul(argv[++i], NULL, 10);
+    else if ( ! strcmp(argv[i], "--tolerance") && i + 1 < argc )
+      tolerance = strtoul(argv[++i], NULL, 10);
+    else if ( ! strcmp(argv[i], "--serial") )
+      serial = 1;
+    else if ( ! strcmp(argv[i], "--eeprom") && i + 1 < argc )
+      eeprom = argv[++i];
+    else
+      session = argv[i];
+  }
+
+  if ( ! session ) {
+    fprintf(stderr, "uso: %s sesion.txt [--expect linea-de-tiempo.txt] [--tolerance ticks] [--ticks n] [--serial] [--eeprom archivo]\n", argv[0]);
+    return 2;
+  }
+
+  if ( ! readSession(session) )
+    return 2;
+
+  if ( serial && ! openSerial() )
+    return 2;
+
+  if ( eeprom ) {
+    FILE *file = fopen(eeprom, "rb");
+    if ( file ) {
+      if ( fread(__eeprom, 1, sizeof(__eeprom), file) != sizeof(__eeprom) )
+        fprintf(stderr, "aviso: %s incompleto\n", eeprom);
+      fclose(file);
+    }
+  }
+
+  if ( ! ticks )
+    ticks = serial ? (unsigned long) -1 : (inputs.empty() ? 0 : inputs.back().tick) + SETTLE_TICKS;
+
+  Board::onOutput = onOutput;
+  Board::onFrame = onFrame;
+
+  size_t next = 0;
+
+  // Estado inicial de los pines (tick 0) antes del arranque
+  for ( ; next < inputs.size() && inputs[next].tick == 0 ; next++ )
+    Board::input(inputs[next].pin, inputs[next].level);
+
+  struct timespec start;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+
+  setup();
+  loop();
+
+  for ( tick = 1 ; tick <= ticks && tick ; tick++ ) {
+
+    if ( serial )
+      pace(start);
+
+    for ( ; next < inputs.size() && inputs[next].tick <= tick ; next++ )
+      Board::input(inputs[next].pin, inputs[next].level);
+
+    Board::advance(TICK_MICROS);
+    TICK_VECTOR();
+    loop();
+  }
+
+  if ( eeprom ) {
+    FILE *file = fopen(eeprom, "wb");
+    if ( ! file || fwrite(__eeprom, 1, sizeof(__eeprom), file) != sizeof(__eeprom) )
+      perror(eeprom);
+    if ( file )
+      fclose(file);
+  }
+
+  if ( ! expect ) {
+    for ( size_t i = 0 ; i < timeline.size() ; i++ )
+      print(stdout, timeline[i]);
+    return 0;
+  }
+
+  std::vector<Change> expected;
+  if ( ! readTimeline(expect, expected) )
+    return 2;
+
+  return compare(expected, tolerance);
+}
@@ -0,0 +1,505 @@
+/*
+ * station-sim.cpp
+ * Copyright 2020 - Juan C. Bryksa (jcbryksa@gmail.com)
+ *
+ * Estacion simulada en el host: el firmware completo corre sobre la placa
+ * virtual (native/) en tiempo virtual, mas rapido que el tiempo real, junto
+ * con un modelo de la planta:
+ *  - la cabina se desplaza entre los finales de carrera de cada piso mientras
+ *    los pines 9/10 del motor estan activos (velocidad proporcional al PWM y
+ *    con la inercia de un sistema de primer orden)
+ *  - el display de 7 segmentos se decodifica a partir de sus pines
+ *  - la tira de Station::PIXELS pixeles se reconstruye con cada show()
+ *
+ *   pio run -e native && .pio/build/native/program [opciones]
+ *
+ *   --trips n        recorridos automaticos a pisos aleatorios (20)
+ *   --seed n         semilla de los pisos y teclas (1)
+ *   --speed mm/s     velocidad de la cabina con el motor a pleno (100)
+ *   --script archivo teclas programadas ("tick tecla", tecla 0 a Station::KEYS - 1), en vez
+ *                    de los recorridos automaticos
+ *   --ticks n        duracion maxima (ticks de 1 ms)
+ *   --overshoot piso arranca con la cabina pasada medio final de carrera de ese
+ *                    piso (0 a FLOORS - 1: el primero bajando, los demas subiendo)
+ *                    y el recorrido interrumpido hacia el en el Journal; al
+ *                    arrancar debe volver a el sin chocar con un tope
+ *   --verbose        informa cada evento de la planta
+ *
+ * Informa las latencias de cada recorrido (desde la liberacion de la tecla
+ * hasta el arranque del motor, la llegada al piso y el display actualizado),
+ * las del encendido de las luces y el rendimiento de la simulacion. Retorna
+ * 1 si la cabina llego a un piso equivocado, choco con un extremo o un
+ * recorrido no concluyo a tiempo.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <chrono>
+#include <vector>
+
+#include <Arduino.h>
+#include "board.h"
+#include "common.hpp"
+#include "elevator.hpp"
+#include "journal.hpp"
+
+#if ASYNC_LOOP_ABSOLUTE
+#error "la simulacion avanza un tick fijo por interrupcion"
+#endif
+
+#if ASYNC_LOOP_TIMER == 0
+#define TICK_VECTOR TIMER0_COMPB_vect
+#define TICK_MICROS TIMER0_TICK_MICROS
+#elif ASYNC_LOOP_TIMER == 1
+#define TICK_VECTOR TIMER1_OVF_vect
+#define TICK_MICROS 1000UL
+#else
+#define TICK_VECTOR TIMER2_COMPA_vect
+#define TICK_MICROS 1000UL
+#endif
+
+extern "C" void TICK_VECTOR(void);
+
+// Conexiones de la estacion: las mismas del firmware (Station)
+#define MOTOR_UP_PIN    Station::ENGINE_PIN_A
+#define MOTOR_DOWN_PIN  Station::ENGINE_PIN_B
+#define LIGHT_KEY       Station::LIGHT_KEY
+#define FLOORS          Station::FLOORS
+
+// Planta
+#define FLOOR_HEIGHT    150.0      // mm entre pisos
+#define SWITCH_WIDTH    10.0       // mm en que cada final de carrera permanece accionado
+#define SHAFT_MARGIN    20.0       // mm por debajo del primer piso y sobre el ultimo (topes)
+#define MOTOR_TAU       0.05       // s, constante de tiempo de la cabina
+#define TOTAL_PIXELS    Station::PIXELS
+
+// Escenario
+#define KEY_PRESS_MS    80         // duracion de cada pulsacion
+#define SETTLE_MS       500        // reposo de la cabina antes de la pulsacion siguiente
+#define TRIP_TIMEOUT_MS 15000
+#define OVERSHOOT       5.0        // mm mas alla del final de carrera liberado
+
+typedef struct {
+  unsigned long tick;
+  uint8_t key;
+} KeyPress;
+
+static unsigned long tick = 0;
+static int verbose = 0;
+static double speed = 100.0;
+
+static double position = 0.0;      // mm sobre el primer piso
+static double velocity = 0.0;      // mm/s
+static uint8_t pixels[TOTAL_PIXELS * 3];
+static unsigned long frames = 0;
+static int failures = 0;
+
+static uint32_t seed = 1;
+
+// xorshift32: la misma secuencia en cualquier plataforma
+static uint32_t random32() {
+  seed ^= seed << 13;
+  seed ^= seed >> 17;
+  seed ^= seed << 5;
+  return seed;
+}
+
+
+static void onFrame(uint8_t, const uint8_t *strip, uint16_t count) {
+  memcpy(pixels, strip, ((count < TOTAL_PIXELS) ? count : TOTAL_PIXELS) * 3);
+  frames++;
+}
+
+
+static uint8_t litPixels() {
+  uint8_t lit = 0;
+  for ( int i = 0 ; i < TOTAL_PIXELS ; i++ )
+    if ( pixels[i * 3] || pixels[i * 3 + 1] || pixels[i * 3 + 2] )
+      lit++;
+  return lit;
+}
+
+
+/*
+ * Digito que muestra el display (-1 si ninguno). El segmento f no esta
+ * conectado (pin 99), por lo que no se considera
+ */
+static int shownDigit() {
+
+  static const uint8_t numbers[] = {
+    0x3F, 0x06, 0x5B, 0x4F, 0x66, 0x6D, 0x7D, 0x07, 0x7F, 0x6F
+  };
+
+  uint8_t segments = 0;
+  for ( int i = 0 ; i < 7 ; i++ )
+    if ( Board::output(Station::displayPins[i]) )
+      segments |= 1 << i;
+
+  for ( int digit = 0 ; digit < 10 ; digit++ )
+    if ( (numbers[digit] & ~0x20) == (segments & ~0x20) )
+      return digit;
+
+  return -1;
+}
+
+
+static uint8_t switchedFloor() {
+  for ( uint8_t floor = 0 ; floor < FLOORS ; floor++ )
+    if ( fabs(position - floor * FLOOR_HEIGHT) <= SWITCH_WIDTH / 2 )
+      return floor;
+  return NO_FLOOR;
+}
+
+
+static int motorDrive() {
+  // Con PWM el valor es el ciclo de trabajo; con digitalWrite, HIGH es pleno
+  int up = Board::output(MOTOR_UP_PIN);
+  int down = Board::output(MOTOR_DOWN_PIN);
+  if ( up == HIGH && up != 255 )
+    up = 255;
+  if ( down == HIGH && down != 255 )
+    down = 255;
+  return up - down;
+}
+
+
+/*
+ * Avanza la planta un tick y actualiza los finales de carrera
+ */
+static void stepPlant() {
+
+  double dt = TICK_MICROS / 1e6;
+  double target = speed * motorDrive() / 255.0;
+
+  velocity += (target - velocity) * dt / MOTOR_TAU;
+  position += velocity * dt;
+
+  double bottom = -SHAFT_MARGIN;
+  double top = (FLOORS - 1) * FLOOR_HEIGHT + SHAFT_MARGIN;
+
+  // Cada choque con un tope se cuenta una vez
+  static uint8_t atStop = 0;
+
+  if ( position < bottom || position > top ) {
+    position = (position < bottom) ? bottom : top;
+    velocity = 0;
+    if ( ! atStop ) {
+      printf("error: %lu choque con el tope %s\n", tick, (position == bottom) ? "inferior" : "superior");
+      failures++;
+    }
+    atStop = 1;
+  }
+  else
+    atStop = 0;
+
+  for ( uint8_t floor = 0 ; floor < FLOORS ; floor++ )
+    Board::input(Station::floors[floor].limitSwitch, fabs(position - floor * FLOOR_HEIGHT) <= SWITCH_WIDTH / 2 ? LOW : HIGH);
+}
+
+
+/*
+ * Un tick completo: planta, interrupcion del AsynchLoop y una pasada de loop()
+ */
+static void step() {
+  tick++;
+  stepPlant();
+  Board::advance(TICK_MICROS);
+  TICK_VECTOR();
+  loop();
+}
+
+
+static void press(uint8_t key) {
+  Board::input(Station::keyPin(key), LOW);
+  for ( int i = 0 ; i < KEY_PRESS_MS ; i++ )
+    step();
+  Board::input(Station::keyPin(key), HIGH);
+}
+
+
+/*
+ * Estadistica de latencias (ms)
+ */
+typedef struct {
+  const char *name;
+  unsigned long count;
+  unsigned long total;
+  unsigned long worst;
+} Latency;
+
+static void measure(Latency &latency, unsigned long ms) {
+  latency.count++;
+  latency.total += ms;
+  if ( ms > latency.worst )
+    latency.worst = ms;
+}
+
+static void report(const Latency &latency) {
+  if ( latency.count )
+    printf("%-24s %6lu  media %7.1f ms  peor %6lu ms\n", latency.name, latency.count,
+           (double) latency.total / latency.count, latency.worst);
+}
+
+
+static Latency motorStart = { "tecla -> motor", 0, 0, 0 };
+static Latency arrival = { "tecla -> piso", 0, 0, 0 };
+static Latency motorStop = { "tecla -> motor detenido", 0, 0, 0 };
+static Latency displayed = { "tecla -> display", 0, 0, 0 };
+static Latency lightFrame = { "tecla -> luces", 0, 0, 0 };
+
+
+/*
+ * Solicita un piso y sigue el recorrido hasta que la cabina se detiene
+ */
+static void trip(uint8_t floor) {
+
+  if ( verbose )
+    printf("%lu tecla piso %d (cabina en %.1f mm)\n", tick, floor + 1, position);
+
+  press(floor);
+
+  unsigned long released = tick;
+  unsigned long started = 0, arrived = 0, stopped = 0, shown = 0;
+  uint8_t reached = NO_FLOOR;
+
+  while ( tick - released < TRIP_TIMEOUT_MS ) {
+
+    step();
+
+    int drive = motorDrive();
+
+    if ( ! started && drive ) {
+      started = tick;
+      measure(motorStart, started - released);
+    }
+
+    if ( started && ! arrived && switchedFloor() != NO_FLOOR && switchedFloor() != reached ) {
+      reached = switchedFloor();
+      if ( reached == floor ) {
+        arrived = tick;
+        measure(arrival, arrived - released);
+      }
+    }
+
+    if ( arrived && ! stopped && ! drive ) {
+      stopped = tick;
+      measure(motorStop, stopped - released);
+    }
+
+    if ( ! shown && stopped && shownDigit() == floor + 1 ) {
+      shown = tick;
+      measure(displayed, shown - released);
+    }
+
+    if ( shown && tick - shown >= SETTLE_MS )
+      break;
+  }
+
+  if ( verbose )
+    printf("%lu cabina detenida en %.1f mm (piso %d)\n", tick, position,
+           (switchedFloor() == NO_FLOOR) ? 0 : switchedFloor() + 1);
+
+  if ( ! shown || switchedFloor() != floor ) {
+    printf("error: recorrido al piso %d sin concluir (tick %lu, cabina en %.1f mm)\n", floor + 1, tick, position);
+    failures++;
+  }
+}
+
+
+static void toggleLight() {
+
+  unsigned long before = frames;
+
+  press(LIGHT_KEY);
+
+  unsigned long released = tick;
+  while ( frames == before && tick - released < 1000 )
+    step();
+
+  if ( frames != before )
+    measure(lightFrame, tick - released);
+
+  // Deja concluir la escena
+  for ( int i = 0 ; i < 2000 ; i++ )
+    step();
+
+  if ( verbose )
+    printf("%lu luces: %d pixeles encendidos\n", tick, litPixels());
+}
+
+
+#if JOURNAL_ENABLED
+/*
+ * Deja la cabina pasada del piso y en la EEPROM el registro de un recorrido
+ * interrumpido hacia el (mismo formato que Journal: secuencia, estado y CRC)
+ */
+static void overshoot(uint8_t floor) {
+
+  struct {
+    uint8_t sequence;
+    Journal::State state;
+    uint8_t crc;
+  } record;
+
+  memset(&record, 0x00, sizeof(record));
+  record.state.floor = floor;
+  record.state.direction = (floor == 0) ? Elevator::DOWN : Elevator::UP;
+  record.state.target = floor;
+
+  record.crc = JOURNAL_VERSION;
+  for ( size_t i = 0 ; i < offsetof(__typeof__(record), crc) ; i++ )
+    record.crc = _crc8_ccitt_update(record.crc, ((uint8_t *) &record)[i]);
+
+  eeprom_update_block(&record, (void *) JOURNAL_ADDRESS, sizeof(record));
+
+  double past = SWITCH_WIDTH / 2 + OVERSHOOT;
+  position = floor * FLOOR_HEIGHT + ((floor == 0) ? -past : past);
+}
+#endif
+
+
+static int readScript(const char *path, std::vector<KeyPress> &script) {
+
+  FILE *file = fopen(path, "r");
+  if ( ! file ) {
+    perror(path);
+    return 0;
+  }
+
+  char line[128];
+  while ( fgets(line, sizeof(line), file) ) {
+    KeyPress press;
+    unsigned int key;
+    if ( sscanf(line, "%lu %u", &press.tick, &key) == 2 && key < Station::KEYS ) {
+      press.key = key;
+      script.push_back(press);
+    }
+  }
+
+  fclose(file);
+  return 1;
+}
+
+
+int main(int argc, char *argv[]) {
+
+  unsigned long trips = 20;
+  unsigned long ticks = 0;
+  const char *scriptPath = NULL;
+  uint8_t overshotFloor = NO_FLOOR;
+
+  for ( int i = 1 ; i < argc ; i++ ) {
+    if ( ! strcmp(argv[i], "--trips") && i + 1 < argc )
+      trips = strtoul(argv[++i], NULL, 10);
+    else if ( ! strcmp(argv[i], "--seed") && i + 1 < argc )
+      seed = strtoul(argv[++i], NULL, 10);
+    else if ( ! strcmp(argv[i], "--speed") && i + 1 < argc )
+      speed = atof(argv[++i]);
+    else if ( ! strcmp(argv[i], "--script") && i + 1 < argc )
+      scriptPath = argv[++i];
+    else if ( ! strcmp(argv[i], "--ticks") && i + 1 < argc )
+      ticks = strtoul(argv[++i], NULL, 10);
+    else if ( ! strcmp(argv[i], "--overshoot") && i + 1 < argc && JOURNAL_ENABLED )
+      overshotFloor = strtoul(argv[++i], NULL, 10);
+    else if ( ! strcmp(argv[i], "--verbose") )
+      verbose = 1;
+    else {
+      fprintf(stderr, "uso: %s [--trips n] [--seed n] [--speed mm/s] [--script archivo] [--ticks n] [--overshoot piso] [--verbose]\n", argv[0]);
+      return 2;
+    }
+  }
+
+  if ( ! seed )
+    seed = 1;
+
+  if ( overshotFloor != NO_FLOOR && overshotFloor >= FLOORS ) {
+    fprintf(stderr, "--overshoot: piso 0 a %d\n", FLOORS - 1);
+    return 2;
+  }
+
+#if JOURNAL_ENABLED
+  if ( overshotFloor != NO_FLOOR )
+    overshoot(overshotFloor);
+#endif
+
+  std::vector<KeyPress> script;
+  if ( scriptPath && ! readScript(scriptPath, script) )
+    return 2;
+
+  Board::onFrame = onFrame;
+
+  // Teclas sin presionar y cabina en reposo en el primer piso
+  for ( uint8_t key = 0 ; key < Station::KEYS ; key++ )
+    Board::input(Station::keyPin(key), HIGH);
+  stepPlant();
+
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+  setup();
+  loop();
+
+  if ( scriptPath ) {
+
+    if ( ! ticks )
+      ticks = (script.empty() ? 0 : script.back().tick) + TRIP_TIMEOUT_MS;
+
+    size_t next = 0;
+    while ( tick < ticks ) {
+      if ( next < script.size() && script[next].tick <= tick ) {
+        if ( verbose )
+          printf("%lu tecla %d\n", tick, script[next].key);
+        press(script[next++].key);
+      }
+      else
+        step();
+    }
+
+    printf("cabina en %.1f mm, display %d, %d pixeles encendidos\n", position, shownDigit(), litPixels());
+  }
+  else {
+
+    // Espera que la cabina quede lista en un piso
+    while ( (motorDrive() || switchedFloor() == NO_FLOOR || tick < 2000) && tick < TRIP_TIMEOUT_MS )
+      step();
+
+    uint8_t current = switchedFloor();
+
+    if ( overshotFloor != NO_FLOOR && current != overshotFloor ) {
+      printf("error: la cabina pasada del piso %d no volvio a el al arrancar (cabina en %.1f mm)\n",
+             overshotFloor + 1, position);
+      failures++;
+    }
+
+    for ( unsigned long n = 0 ; n < trips && (! ticks || tick < ticks) ; n++ ) {
+
+      // Cada tanto enciende o apaga las luces
+      if ( random32() % 4 == 0 )
+        toggleLight();
+
+      uint8_t floor = random32() % (FLOORS - 1);
+      if ( floor >= current )
+        floor++;
+
+      trip(floor);
+      current = floor;
+    }
+  }
+
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  report(motorStart);
+  report(arrival);
+  report(motorStop);
+  report(displayed);
+  report(lightFrame);
+
+  printf("tiempo virtual           %8.1f s\n", tick * TICK_MICROS / 1e6);
+  printf("tiempo real              %8.3f s  (%.0fx)\n", seconds, tick * TICK_MICROS / 1e6 / seconds);
+  printf("ticks/s                  %8.0f\n", tick / seconds);
+  printf("cuadros de la tira       %8lu\n", frames);
+  printf("fallas                   %8d\n", failures);
+
+  return failures ? 1 : 0;
+}
@@ -1,13 +1,32 @@
 #include <Arduino.h>
 
 #include "async-loop.hpp"
+#include "trace.hpp"
 
 #ifndef ASYNC_LOOP_CPP
 #define ASYNC_LOOP_CPP
 
 AsynchLoop AsyncLoop;      // preinstatiate
 
+// TICK_PENDING: tick vencido aun no atendido
+// TICK_CYCLES: ciclos de CPU por interrupcion del timer
+#if ASYNC_LOOP_TIMER == 2
+#define TICK_PENDING (TIFR2 & _BV(OCF2A))
+#define TICK_CYCLES ((unsigned long) TICK_COUNTS << 6)
+ISR(TIMER2_COMPA_vect)
+#elif ASYNC_LOOP_TIMER == 0
+#define TICK_PENDING (TIFR0 & _BV(OCF0B))
+#define TICK_CYCLES (256UL << 6)
+ISR(TIMER0_COMPB_vect)
+#elif ASYNC_LOOP_ABSOLUTE
+#define TICK_PENDING (TIFR1 & _BV(OCF1A))
+#define TICK_CYCLES ((unsigned long) TICK_COUNTS << 6)
+ISR(TIMER1_COMPA_vect)
+#else
+#define TICK_PENDING (TIFR1 & _BV(TOV1))
+#define TICK_CYCLES ((2UL * ICR1) << _scale)
 ISR(TIMER1_OVF_vect)       // interrupt service routine that wraps a user defined function supplied by attachInterrupt
+#endif
 {
 
   AsyncLoop.callAsyncLoops();
@@ -20,21 +39,63 @@ void AsynchLoop::_init(long microseconds)
   if ( ! _initialized ) {
 
     _initialized = 1;
+#if ASYNC_LOOP_TIMER == 2
+    TCCR2A = _BV(WGM21);        // modo CTC: reinicia al alcanzar OCR2A
+    TCCR2B = _BV(CS22);         // prescaler /64
+    OCR2A = TICK_COUNTS - 1;
+    TCNT2 = 0;
+#elif ASYNC_LOOP_TIMER == 0
+    OCR0B = 128;                // el Timer0 sigue contando para millis(), solo se agrega la comparacion B
+#else
     TCCR1A = 0;                 // clear control register A
+#endif
+#if ASYNC_LOOP_TIMER != 1 || ASYNC_LOOP_ABSOLUTE
+    (void) microseconds;        // solo el Timer1 con tick fijo admite otro periodo
+#endif
+#if ASYNC_LOOP_TIMER != 1
+#elif ASYNC_LOOP_ABSOLUTE
+    TCCR1B = _BV(CS11) | _BV(CS10); // modo normal (cuenta libre), prescaler /64
+    _deadline = TCNT1 + TICK_COUNTS;
+    OCR1A = _deadline;
+#else
     TCCR1B = _BV(WGM13);        // set mode 8: phase and frequency correct pwm, stop the timer
     setPeriod(microseconds);
+#endif
 
+    // Todos los espacios comienzan en la lista de libres
     memset(_loops, 0x00, sizeof(_loops));
+    for ( int id = 0 ; id < MAX_ASYNC_LOOPS ; id++ )
+      _loops[id].node.next = (id + 1 < MAX_ASYNC_LOOPS) ? id + 1 : NO_LOOP;
+    _free = 0;
+    _head = NO_LOOP;
+
+    // Reserva los primeros espacios para las altas desde loop()
+    while ( _spareHead < SPARE_LOOPS ) {
+      _spares[_spareHead++] = _free;
+      _free = _loops[_free].node.next;
+    }
 
+#if ASYNC_LOOP_TIMER == 2
+    TIFR2 = _BV(OCF2A);
+    TIMSK2 = _BV(OCIE2A);
+#elif ASYNC_LOOP_TIMER == 0
+    TIFR0 = _BV(OCF0B);
+    TIMSK0 |= _BV(OCIE0B);      // TOIE0 sigue habilitada para millis()
+#elif ASYNC_LOOP_ABSOLUTE
+    TIFR1 = _BV(OCF1A);
+    TIMSK1 = _BV(OCIE1A); // habilita la interrupcion por comparacion
+#else
     TIMSK1 = _BV(TOIE1);  // sets the timer overflow interrupt enable bit
 
     resume();
+#endif
 
   }
 
 }
 
 
+#if ASYNC_LOOP_TIMER == 1
 void AsynchLoop::setPeriod(long microseconds)		// AR modified for atomic access
 {
 
@@ -46,6 +107,11 @@ void AsynchLoop::setPeriod(long microseconds)		// AR modified for atomic access
   else if((cycles >>= 2) < RESOLUTION) clockSelectBits = _BV(CS12) | _BV(CS10);  // prescale by /1024
   else        cycles = RESOLUTION - 1, clockSelectBits = _BV(CS12) | _BV(CS10);  // request was out of bounds, set as maximum
 
+#if ASYNC_LOOP_PROFILE
+  const uint8_t scales[] = {0, 0, 3, 6, 8, 10};
+  _scale = scales[clockSelectBits];
+#endif
+
   oldSREG = SREG;
   cli();							// Disable interrupts for 16 bit register access
   ICR1 = cycles;                                          // ICR1 is TOP in p & f correct pwm mode
@@ -54,37 +120,459 @@ void AsynchLoop::setPeriod(long microseconds)		// AR modified for atomic access
   TCCR1B &= ~(_BV(CS10) | _BV(CS11) | _BV(CS12));
   TCCR1B |= clockSelectBits;                                          // reset clock select register, and starts the clock
 }
+#endif
 
 
-AsynchLoop::LoopId AsynchLoop::attach(void (*isr)(), long milliseconds, AsynchLoop::LoopType loopType)
+AsynchLoop::LoopId AsynchLoop::attach(void (*isr)(), long milliseconds, AsynchLoop::LoopType loopType, AsynchLoop::Priority priority,
+                                      uint16_t slack)
 {
-  int id;
+  return _attach((void (*)(void *)) isr, NULL, 0, milliseconds, loopType, priority, slack);
+}
 
+
+AsynchLoop::LoopId AsynchLoop::attach(void (*handler)(void *), void *context, long milliseconds, AsynchLoop::LoopType loopType,
+                                      AsynchLoop::Priority priority, uint16_t slack)
+{
+  return _attach(handler, context, 1, milliseconds, loopType, priority, slack);
+}
+
+
+AsynchLoop::LoopId AsynchLoop::_attach(void (*handler)(void *), void *context, uint8_t withContext,
+                                       long milliseconds, AsynchLoop::LoopType loopType, AsynchLoop::Priority priority,
+                                       uint16_t slack)
+{
   if ( ! _initialized )
     _init();
 
-  for ( id = 0 ; id < MAX_ASYNC_LOOPS ; id++ )
-    if (_loops[id].handlerFunction == NULL)
-      break;
+  // Desde loop(): toma un espacio reservado y encola el alta
+  if ( ! _isrDepth ) {
+
+    if ( _spareTail == _spareHead || _queueFull() )
+      return INVALID_LOOP;
+
+    Slot id = _spares[_spareTail & (SPARE_LOOPS - 1)];
+    _spareTail++;
+
+    _fill(id, handler, context, withContext, milliseconds, loopType, priority, slack);
 
-  _loops[id].loopType = loopType;
-  _loops[id].period = milliseconds;
-  _loops[id].counter = milliseconds;
-  _loops[id].handlerFunction = isr;
+    LoopId loopId = ((LoopId) _loops[id].generation << 8) | id;
+    _post(ATTACH_COMMAND, loopId);
 
-  return id;
+    return loopId;
+  }
+
+  // Desde el ISR (los HIGH_PRIORITY pueden ser interrumpidos por el tick siguiente)
+  char sreg = SREG;
+  cli();
+
+  if ( _free == NO_LOOP ) {
+    SREG = sreg;
+    return INVALID_LOOP;
+  }
+
+  Slot id = _free;
+  _free = _loops[id].node.next;
+
+  _fill(id, handler, context, withContext, milliseconds, loopType, priority, slack);
+
+  if ( milliseconds > 0 ) {
+    _schedule(id, milliseconds, slack);
+#if ASYNC_LOOP_TICKLESS
+    _program();
+#endif
+  }
+
+  LoopId loopId = ((LoopId) _loops[id].generation << 8) | id;
+
+  SREG = sreg;
+
+  return loopId;
+}
+
+
+void AsynchLoop::_fill(AsynchLoop::Slot slot, void (*handler)(void *), void *context, uint8_t withContext,
+                       long milliseconds, AsynchLoop::LoopType loopType, AsynchLoop::Priority priority,
+                       uint16_t slack)
+{
+  _loops[slot].loopType = loopType;
+  _loops[slot].priority = priority;
+  _loops[slot].period = milliseconds;
+  _loops[slot].contextFunction = handler;
+  _loops[slot].context = context;
+  _loops[slot].withContext = withContext;
+  _loops[slot].slack = slack;
+  _loops[slot].node.next = NO_LOOP;
+#if ASYNC_LOOP_PROFILE
+  memset(&_profile[slot], 0x00, sizeof(Profile));
+#endif
+}
+
+
+uint8_t AsynchLoop::_attachTask(const AsynchLoop::Task *task)
+{
+  if ( ! _initialized )
+    _init();
+
+  // Desde cualquier contexto: la lista se modifica directamente
+  char sreg = SREG;
+  cli();
+
+  // Una tarea ya conocida vuelve a su espacio
+  uint8_t index = 0;
+  while ( index < _taskCount && _tasks[index].task != task )
+    index++;
+
+  if ( index == _taskCount ) {
+
+    if ( _taskCount == MAX_ASYNC_TASKS ) {
+      SREG = sreg;
+      return 0;
+    }
+
+    _tasks[index].task = task;
+    _taskCount++;
+#if ASYNC_LOOP_PROFILE
+    memset(&_profile[MAX_ASYNC_LOOPS + index], 0x00, sizeof(Profile));
+#endif
+  }
+  else if ( _tasks[index].attached ) {
+    SREG = sreg;
+    return 1;
+  }
+
+  Slot id = MAX_ASYNC_LOOPS + index;
+  _tasks[index].attached = 1;
+  _tasks[index].node.next = NO_LOOP;
+
+  uint16_t period = pgm_read_word(&task->period);
+
+  if ( period > 0 ) {
+#if ASYNC_LOOP_TICKLESS
+    // Desde loop() la lista aun no desconto los ticks transcurridos desde el ultimo ISR
+    _schedule(id, period + (_isrDepth ? 0 : _unaccounted()), pgm_read_word(&task->slack));
+    if ( _isrDepth )
+      _program();
+    else
+      _wake();
+#else
+    _schedule(id, period, pgm_read_word(&task->slack));
+#endif
+  }
+
+  SREG = sreg;
+
+  return 1;
+}
+
+
+void AsynchLoop::_detachTask(const AsynchLoop::Task *task)
+{
+  char sreg = SREG;
+  cli();
+
+  for ( uint8_t index = 0 ; index < _taskCount ; index++ ) {
+
+    if ( _tasks[index].task != task || ! _tasks[index].attached )
+      continue;
+
+    Slot id = MAX_ASYNC_LOOPS + index;
+    Node &node = _tasks[index].node;
+
+    // Si se quita a si misma desde su callback ya no esta en la lista
+    if ( id == _running )
+      _running = NO_LOOP;
+    else
+      _remove(id);
+
+    // Descarta los vencimientos diferidos que aun no se ejecutaron
+    if ( node.pending ) {
+      _pending[_priority(id)] -= node.pending;
+      node.pending = 0;
+    }
+
+    _tasks[index].attached = 0;
+  }
+
+  SREG = sreg;
 }
 
 
 void AsynchLoop::detach(AsynchLoop::LoopId loopId)
 {
-  //TIMSK1 &= ~_BV(TOIE1);    // clears the timer overflow interrupt enable bit
-															// timer continues to count without calling the isr
-  memset( (void *) &(_loops[loopId]), 0x00, sizeof(Loop));
+  if ( (loopId & 0xFF) >= MAX_ASYNC_LOOPS )
+    return;
+
+  // Desde loop() encola la baja (con la cola llena se aplica en el acto)
+  if ( ! _isrDepth && _post(DETACH_COMMAND, loopId) )
+    return;
 
+  char sreg = SREG;
+  cli();
+  _detach(loopId);
+  SREG = sreg;
 }
 
 
+/*
+ * Baja efectiva del loop (desde el ISR o con las interrupciones deshabilitadas)
+ */
+void AsynchLoop::_detach(AsynchLoop::LoopId loopId)
+{
+  Slot id = loopId & 0xFF;
+
+  // Id de un loop que ya vencio o fue eliminado (el espacio pudo ser reutilizado)
+  if ( ! _loops[id].handlerFunction || _loops[id].generation != (loopId >> 8) )
+    return;
+
+  // Si se elimina a si mismo desde su callback ya no esta en la lista
+  if ( id == _running )
+    _running = NO_LOOP;
+  else
+    _remove(id);
+
+  for ( uint8_t priority = LOW_PRIORITY ; priority < CRITICAL ; priority++ )
+    if ( id == _dispatching[priority] )
+      _dispatching[priority] = NO_LOOP;
+
+  // Descarta los vencimientos diferidos que aun no se ejecutaron
+  if ( _loops[id].node.pending )
+    _pending[_loops[id].priority] -= _loops[id].node.pending;
+
+  _release(id);
+}
+
+
+/*
+ * Indica si la cola de altas y bajas desde loop() esta llena
+ * (el ISR la vacia al comienzo del tick siguiente)
+ */
+inline uint8_t AsynchLoop::_queueFull()
+{
+  return (uint8_t) (_commandHead - _commandTail) == COMMAND_QUEUE_SIZE;
+}
+
+
+/*
+ * Encola un alta o baja pedida desde loop(). Retorna 0 si la cola esta
+ * llena: no se espera al tick siguiente, que con las interrupciones
+ * deshabilitadas nunca llegaria
+ */
+uint8_t AsynchLoop::_post(AsynchLoop::CommandType type, AsynchLoop::LoopId loopId)
+{
+  if ( _queueFull() )
+    return 0;
+
+  volatile Command &command = _commands[_commandHead & (COMMAND_QUEUE_SIZE - 1)];
+  command.type = type;
+  command.loopId = loopId;
+
+  _commandHead++;             // publica el comando
+
+#if ASYNC_LOOP_TICKLESS
+  // El ISR la aplica en el tick siguiente
+  char sreg = SREG;
+  cli();
+  _wake();
+  SREG = sreg;
+#endif
+
+  return 1;
+}
+
+
+/*
+ * Aplica los comandos encolados desde loop() y repone los espacios
+ * reservados. Se invoca al comienzo de cada tick, luego de descontar
+ * el tiempo transcurrido de la lista
+ */
+void AsynchLoop::_applyCommands()
+{
+  while ( _commandTail != _commandHead ) {
+
+    volatile Command &command = _commands[_commandTail & (COMMAND_QUEUE_SIZE - 1)];
+    LoopId loopId = command.loopId;
+    Slot id = loopId & 0xFF;
+
+    // El alta se pidio durante el tick anterior, que ya fue descontado
+    if ( command.type == DETACH_COMMAND )
+      _detach(loopId);
+    else if ( _loops[id].handlerFunction && _loops[id].generation == (loopId >> 8) && _loops[id].period > 0 )
+      _schedule(id, _loops[id].period - 1, _loops[id].slack);
+
+    _commandTail++;
+  }
+
+  while ( (uint8_t) (_spareHead - _spareTail) < SPARE_LOOPS && _free != NO_LOOP ) {
+    _spares[_spareHead & (SPARE_LOOPS - 1)] = _free;
+    _free = _loops[_free].node.next;
+    _spareHead++;
+  }
+}
+
+
+/*
+ * Indica si desde loop() se encolo la baja del loop y el ISR aun no la aplico
+ */
+uint8_t AsynchLoop::_detachPosted(AsynchLoop::Slot slot)
+{
+  LoopId loopId = ((LoopId) _loops[slot].generation << 8) | slot;
+
+  for ( uint8_t i = _commandTail ; i != _commandHead ; i++ )
+    if ( _commands[i & (COMMAND_QUEUE_SIZE - 1)].type == DETACH_COMMAND &&
+         _commands[i & (COMMAND_QUEUE_SIZE - 1)].loopId == loopId )
+      return 1;
+
+  return 0;
+}
+
+
+/*
+ * Devuelve el espacio a la lista de libres invalidando los ids que lo referencian
+ */
+void AsynchLoop::_release(AsynchLoop::Slot slot)
+{
+  uint8_t generation = _loops[slot].generation + 1;
+
+  memset( (void *) &(_loops[slot]), 0x00, sizeof(Loop));
+
+  _loops[slot].generation = generation;
+  _loops[slot].node.next = _free;
+  _free = slot;
+}
+
+
+/*
+ * Nodo de la lista de vencimientos de un loop o de una tarea fija
+ */
+inline AsynchLoop::Node &AsynchLoop::_node(AsynchLoop::Slot slot)
+{
+  return (slot < MAX_ASYNC_LOOPS) ? _loops[slot].node : _tasks[slot - MAX_ASYNC_LOOPS].node;
+}
+
+
+inline AsynchLoop::Ticks AsynchLoop::_period(AsynchLoop::Slot slot)
+{
+  if ( slot < MAX_ASYNC_LOOPS )
+    return _loops[slot].period;
+
+  return pgm_read_word(&_tasks[slot - MAX_ASYNC_LOOPS].task->period);
+}
+
+
+inline AsynchLoop::Priority AsynchLoop::_priority(AsynchLoop::Slot slot)
+{
+  if ( slot < MAX_ASYNC_LOOPS )
+    return _loops[slot].priority;
+
+  return (Priority) pgm_read_byte(&_tasks[slot - MAX_ASYNC_LOOPS].task->priority);
+}
+
+
+// Las tareas fijas son siempre ciclicas
+inline uint8_t AsynchLoop::_cyclic(AsynchLoop::Slot slot)
+{
+  return slot >= MAX_ASYNC_LOOPS || _loops[slot].loopType == CYCLIC;
+}
+
+
+/*
+ * Inserta el loop en la lista de vencimientos, a continuacion
+ * de los que vencen en el mismo tick o antes
+ */
+void AsynchLoop::_insert(AsynchLoop::Slot slot, Ticks ticks)
+{
+  uint8_t *link = &_head;
+
+  while ( *link != NO_LOOP && _node(*link).delta <= ticks ) {
+    ticks -= _node(*link).delta;
+    link = &_node(*link).next;
+  }
+
+  if ( *link != NO_LOOP )
+    _node(*link).delta -= ticks;
+
+  _node(slot).delta = ticks;
+  _node(slot).next = *link;
+  *link = slot;
+}
+
+
+/*
+ * Primera insercion de un loop: dentro de la tolerancia lo demora hasta el
+ * proximo multiplo de su periodo (asi los periodos multiplos entre si quedan
+ * en fase) o, si no alcanza, hasta el primer vencimiento ya programado
+ */
+void AsynchLoop::_schedule(AsynchLoop::Slot slot, Ticks ticks, uint16_t slack)
+{
+  if ( slack ) {
+
+    unsigned long period = _period(slot);
+    unsigned long offset = (period - (_now + ticks) % period) % period;
+
+    if ( offset <= slack )
+      ticks += offset;
+    else {
+      Ticks deadline = 0;
+      for ( uint8_t id = _head ; id != NO_LOOP ; id = _node(id).next ) {
+        deadline += _node(id).delta;
+        if ( deadline > ticks + slack )
+          break;
+        if ( deadline >= ticks ) {
+          ticks = deadline;
+          break;
+        }
+      }
+    }
+  }
+
+  _insert(slot, ticks);
+}
+
+
+/*
+ * Vuelve a insertar un loop ciclico que vencio con `late` ticks de atraso
+ * manteniendo la fase de sus vencimientos
+ */
+void AsynchLoop::_reschedule(AsynchLoop::Slot slot, Ticks late)
+{
+  Ticks period = _period(slot);
+
+  if ( late <= 0 )
+    _insert(slot, period);
+#if ASYNC_LOOP_CATCH_UP
+  else
+    _insert(slot, period - late);          // si sigue vencido se vuelve a ejecutar en este tick
+#else
+  else
+    _insert(slot, period - late % period); // una unica ejecucion por los periodos perdidos
+#endif
+}
+
+
+/*
+ * Quita el loop de la lista de vencimientos (si esta en ella)
+ * cediendo su delta al nodo siguiente
+ */
+void AsynchLoop::_remove(AsynchLoop::Slot slot)
+{
+  uint8_t *link = &_head;
+
+  while ( *link != NO_LOOP && *link != slot )
+    link = &_node(*link).next;
+
+  if ( *link == NO_LOOP )
+    return;
+
+  Node &node = _node(slot);
+
+  if ( node.next != NO_LOOP )
+    _node(node.next).delta += node.delta;
+
+  *link = node.next;
+}
+
+
+#if ASYNC_LOOP_TIMER == 1
 void AsynchLoop::resume()				// AR suggested
 {
   TCCR1B |= clockSelectBits;
@@ -168,32 +656,476 @@ unsigned long AsynchLoop::read()    //returns the value of the timer in microsec
 	tmp = (  (tcnt1>tmp) ? (tmp) : (long)(ICR1-tcnt1)+(long)ICR1  );		// AR amended to add casts and reuse previous TCNT1
 	return ((tmp*1000L)/(F_CPU /1000L))<<scale;
 }
+#endif
 
 
 // JCB CUSTOM
 
 void AsynchLoop::callAsyncLoops() {
 
-  for ( int id = 0 ; id < MAX_ASYNC_LOOPS ; id++ )
-    if ( _loops[id].handlerFunction && _loops[id].counter ) {
+#if TRACE_ENABLED > 1
+  TRACE(TICK_BEGIN, _isrDepth);
+#endif
+
+  _isrDepth++;
+
+#if ASYNC_LOOP_PROFILE
+#if ASYNC_LOOP_ABSOLUTE
+  uint16_t count = TCNT1;
+  _cycleBase += (unsigned long) (uint16_t) (count - _cycleCount) << 6;
+  _cycleCount = count;
+#else
+  _cycleBase += TICK_CYCLES;
+#endif
+
+  // Los HIGH_PRIORITY del tick anterior aun no concluyeron
+  if ( _highPhase && _overruns < 0xFFFF )
+    _overruns++;
+#endif
+
+#if ASYNC_LOOP_ABSOLUTE
+  long elapsed = _elapsedTicks();
+#elif ASYNC_LOOP_TIMER == 0
+  _extraMicros += TIMER0_TICK_MICROS - 1000;
+  long elapsed = 1;
+  while ( _extraMicros >= 1000 ) {
+    _extraMicros -= 1000;
+    elapsed++;
+  }
+#else
+  long elapsed = 1;
+#endif
+
+  _now += elapsed;
+
+  if ( _head != NO_LOOP )
+    _node(_head).delta -= elapsed;
 
-      _loops[id].counter--;
+  _applyCommands();
 
-      if ( _loops[id].counter == 0 ) {
+  // Ejecuta todos los loops vencidos en este tick (delta 0 o negativo, si se atrasaron, al frente de la lista)
+  while ( _head != NO_LOOP && _node(_head).delta <= 0 ) {
 
-        _loops[id].handlerFunction();
+    Slot id = _head;
+    Node &node = _node(id);
+    Priority priority = _priority(id);
+    Ticks late = -node.delta;
+    _head = node.next;
 
-        if ( _loops[id].loopType == CYCLIC )
-          _loops[id].counter = _loops[id].period;
-        else
-          _loops[id].handlerFunction = NULL; // disponibiliza el espacio
+    // El siguiente hereda el atraso
+    if ( _head != NO_LOOP )
+      _node(_head).delta -= late;
 
+    // Los no criticos solo se marcan; se ejecutan y liberan luego, con las interrupciones habilitadas
+    if ( priority != CRITICAL ) {
+      if ( node.pending < 255 ) {
+        node.pending++;
+        _pending[priority]++;
       }
+      if ( _cyclic(id) )
+        _reschedule(id, late);
+      continue;
+    }
+
+    _running = id;
+
+    _call(id);
+
+    // Si el callback no se elimino a si mismo se reprograma o se libera
+    if ( _running == id ) {
+      if ( _cyclic(id) )
+        _reschedule(id, late);
+      else
+        _release(id); // disponibiliza el espacio
+    }
+
+    _running = NO_LOOP;
+
+  }
+
+#if ASYNC_LOOP_PROFILE
+  // Los CRITICAL de este tick se extendieron hasta el tick siguiente
+  if ( TICK_PENDING && _overruns < 0xFFFF )
+    _overruns++;
+#endif
+
+  /* Ejecuta los HIGH_PRIORITY con las interrupciones habilitadas para que
+   * el tick siguiente pueda desalojarlos. El ISR anidado solo ejecuta sus
+   * CRITICAL; sus HIGH_PRIORITY quedan para este mismo ciclo
+   */
+  if ( _pending[HIGH_PRIORITY] && ! _highPhase ) {
+    _highPhase = 1;
+    do {
+      sei();
+      _runPending(HIGH_PRIORITY);
+      cli();
+    } while ( _pending[HIGH_PRIORITY] );
+    _highPhase = 0;
+  }
+
+#if ASYNC_LOOP_TICKLESS
+  _program();
+#endif
+
+  _isrDepth--;
+
+#if TRACE_ENABLED > 1
+  TRACE(TICK_END, _isrDepth);
+#endif
+
+}
+
+
+void AsynchLoop::dispatch() {
+
+  if ( _pending[LOW_PRIORITY] )
+    _runPending(LOW_PRIORITY);
+
+}
+
+
+uint8_t AsynchLoop::pending() {
+
+  return _pending[LOW_PRIORITY] || _commandHead != _commandTail;
+
+}
+
+
+unsigned long AsynchLoop::ticks() {
+
+  char sreg = SREG;
+  cli();
+#if ASYNC_LOOP_TICKLESS
+  unsigned long now = _now + _unaccounted();
+#else
+  unsigned long now = _now;
+#endif
+  SREG = sreg;
+
+  return now;
+}
+
+
+uint8_t AsynchLoop::active() {
+
+  if ( ! _initialized )
+    return 0;
+
+  char sreg = SREG;
+  cli();
+
+  uint8_t available = _spareHead - _spareTail;
+  for ( uint8_t id = _free ; id != NO_LOOP ; id = _loops[id].node.next )
+    available++;
+
+  SREG = sreg;
+
+  return MAX_ASYNC_LOOPS - available;
+}
+
+
+long AsynchLoop::nextDeadline() {
+
+  char sreg = SREG;
+  cli();
+
+  Ticks deadline = 0;
+  uint8_t id = _head;
+
+  while ( id != NO_LOOP ) {
+    deadline += _node(id).delta;
+    if ( id < MAX_ASYNC_LOOPS )
+      break;
+    id = _node(id).next;
+  }
+
+#if ASYNC_LOOP_TICKLESS
+  deadline -= _unaccounted();
+#endif
+
+  SREG = sreg;
+
+  if ( id == NO_LOOP )
+    return -1;
+
+  return (deadline > 0) ? deadline : 0;
+
+}
+
+
+/*
+ * Ejecuta los vencimientos pendientes de la prioridad indicada
+ * Debe invocarse con las interrupciones habilitadas
+ */
+void AsynchLoop::_runPending(AsynchLoop::Priority priority) {
+
+  for ( int id = 0 ; id < MAX_ASYNC_LOOPS + _taskCount ; id++ )
+    while ( _node(id).pending && _priority(id) == priority ) {
+
+      // Baja pedida desde loop() que el ISR aun no aplico
+      if ( priority == LOW_PRIORITY && id < MAX_ASYNC_LOOPS && _detachPosted(id) )
+        break;
+
+      char sreg = SREG;
+      cli();
+      _node(id).pending--;
+      _pending[priority]--;
+      _dispatching[priority] = id;
+      SREG = sreg;
+
+      _call(id);
+
+      // Un ONE_TIME que no se elimino a si mismo libera su espacio
+      sreg = SREG;
+      cli();
+      if ( _dispatching[priority] == id && ! _cyclic(id) )
+        _release(id);
+      _dispatching[priority] = NO_LOOP;
+      SREG = sreg;
 
     }
 
 }
 
+
+/*
+ * Ejecuta el callback del loop (midiendo su duracion si esta habilitado el perfilado)
+ */
+void AsynchLoop::_call(AsynchLoop::Slot slot) {
+
+#if ASYNC_LOOP_PROFILE
+  unsigned long begin = _cycles();
+  _invoke(slot);
+  unsigned long cycles = _cycles() - begin;
+
+  Profile &profile = _profile[slot];
+  uint16_t last = (cycles > 0xFFFF) ? 0xFFFF : cycles;
+
+  profile.count++;
+  profile.total += cycles;
+  profile.last = last;
+  if ( last > profile.max )
+    profile.max = last;
+  if ( cycles > TICK_CYCLES && profile.overruns < 0xFFFF )
+    profile.overruns++;
+#else
+  _invoke(slot);
+#endif
+
+}
+
+
+inline void AsynchLoop::_invoke(AsynchLoop::Slot slot) {
+
+  if ( slot >= MAX_ASYNC_LOOPS ) {
+    const Task *task = _tasks[slot - MAX_ASYNC_LOOPS].task;
+    void (*handler)(void *) = (void (*)(void *)) pgm_read_ptr(&task->handler);
+    handler(pgm_read_ptr(&task->context));
+  }
+  else if ( _loops[slot].withContext )
+    _loops[slot].contextFunction(_loops[slot].context);
+  else
+    _loops[slot].handlerFunction();
+
+}
+
+
+#if ASYNC_LOOP_PROFILE
+/*
+ * Ciclos de CPU transcurridos desde la inicializacion, a partir de la
+ * posicion del timer en el periodo actual (el Timer1 sube hasta ICR1 y luego baja)
+ */
+unsigned long AsynchLoop::_cycles() {
+
+#if ASYNC_LOOP_TIMER != 1
+  char sreg = SREG;
+  cli();
+#if ASYNC_LOOP_TIMER == 2
+  unsigned long counts = TCNT2;
+  if ( TICK_PENDING )          // la cuenta ya se reinicio: se relee ya en el periodo siguiente
+    counts = TCNT2 + TICK_COUNTS;
+#else
+  unsigned long counts = (uint8_t) (TCNT0 - OCR0B);
+  if ( TICK_PENDING )
+    counts = (uint8_t) (TCNT0 - OCR0B) + 256UL;
+#endif
+  unsigned long base = _cycleBase;
+  SREG = sreg;
+
+  return base + (counts << 6);
+#elif ASYNC_LOOP_ABSOLUTE
+  // Con cuenta libre alcanza con lo transcurrido desde el ultimo tick
+  char sreg = SREG;
+  cli();
+  uint16_t count = TCNT1;
+  unsigned long base = _cycleBase;
+  uint16_t last = _cycleCount;
+  SREG = sreg;
+
+  return base + ((unsigned long) (uint16_t) (count - last) << 6);
+#else
+  char sreg = SREG;
+  cli();
+  unsigned int first = TCNT1;
+  unsigned int second = TCNT1;
+  unsigned long base = _cycleBase;
+  uint8_t overflow = TIFR1 & _BV(TOV1);
+  SREG = sreg;
+
+  unsigned long counts = (second >= first) ? second : 2UL * ICR1 - second;
+
+  // Overflow aun no atendido: ya se esta en el periodo siguiente
+  if ( overflow && second >= first )
+    counts += 2UL * ICR1;
+
+  return base + (counts << _scale);
+#endif
+}
+
+
+void AsynchLoop::report(Print &out) {
+
+  out.println(F("id\thandler\tcount\tlast\tmax\ttotal\toverruns"));
+
+  for ( int id = 0 ; id < MAX_ASYNC_LOOPS + _taskCount ; id++ ) {
+
+    const void *handler = (id < MAX_ASYNC_LOOPS) ? (const void *) _loops[id].handlerFunction
+                                                 : pgm_read_ptr(&_tasks[id - MAX_ASYNC_LOOPS].task->handler);
+
+    if ( ! handler && ! _profile[id].count )
+      continue;
+
+    char sreg = SREG;
+    cli();
+    Profile profile = _profile[id];
+    SREG = sreg;
+
+    out.print(id);
+    out.print('\t');
+    out.print((uintptr_t) handler, HEX);
+    out.print('\t');
+    out.print(profile.count);
+    out.print('\t');
+    out.print(profile.last);
+    out.print('\t');
+    out.print(profile.max);
+    out.print('\t');
+    out.print(profile.total);
+    out.print('\t');
+    out.println(profile.overruns);
+  }
+
+  out.print(F("tick overruns: "));
+  out.println(_overruns);
+#if ASYNC_LOOP_ABSOLUTE
+  out.print(F("missed ticks: "));
+  out.println(missedTicks());
+#endif
+
+}
+#endif
+
+#if ASYNC_LOOP_ABSOLUTE
+/*
+ * Calcula con la cuenta libre del Timer1 cuantos ticks transcurrieron desde
+ * el vencimiento atendido por el ISR anterior y programa el siguiente
+ */
+long AsynchLoop::_elapsedTicks() {
+
+  uint16_t late = TCNT1 - _deadline;   // cuentas desde el vencimiento de este tick
+  long elapsed = 1 + late / TICK_COUNTS;
+
+  // Si el proximo vencimiento queda demasiado cerca la comparacion podria
+  // perderse mientras se escribe OCR1A: se lo atiende en este mismo tick
+  if ( TICK_COUNTS - late % TICK_COUNTS < 2 )
+    elapsed++;
+
+#if ASYNC_LOOP_TICKLESS
+  // Los ticks hasta la comparacion programada se omitieron, no se perdieron
+  if ( elapsed > _programmed )
+    _missedTicks += elapsed - _programmed;
+#else
+  _missedTicks += elapsed - 1;
+#endif
+  _deadline += elapsed * TICK_COUNTS;
+  OCR1A = _deadline;
+
+  return elapsed;
+}
+
+
+#if ASYNC_LOOP_TICKLESS
+/*
+ * Ticks completos transcurridos desde el ultimo descontado por el ISR
+ * (con las interrupciones deshabilitadas)
+ */
+AsynchLoop::Ticks AsynchLoop::_unaccounted() {
+
+  int16_t late = TCNT1 - _deadline;  // cuentas desde el primer tick no descontado
+
+  return (late < 0) ? 0 : 1 + (uint16_t) late / TICK_COUNTS;
+}
+
+
+/*
+ * Adelanta la comparacion al proximo tick para que el ISR aplique cuanto
+ * antes un alta o baja pedida desde loop() (con las interrupciones deshabilitadas)
+ */
+void AsynchLoop::_wake() {
+
+  uint16_t count = TCNT1;
+  uint16_t compare = _deadline + (_unaccounted() * TICK_COUNTS);
+
+  if ( (int16_t) (compare - count) < 2 )
+    compare += TICK_COUNTS;
+
+  // Solo si vence antes que la programada (y esta no ocurrio aun)
+  if ( (int16_t) (compare - OCR1A) < 0 && (int16_t) (OCR1A - count) > 0 ) {
+    OCR1A = compare;
+    _programmed = 1 + (uint16_t) (compare - _deadline) / TICK_COUNTS;
+  }
+
+}
+
+
+/*
+ * Programa la comparacion en el primer vencimiento de la lista, o en el
+ * tick siguiente si hay altas o bajas de loop() por aplicar
+ */
+void AsynchLoop::_program() {
+
+  Ticks next = TICKLESS_MAX_PERIOD;
+
+  if ( _commandHead != _commandTail )
+    next = 1;
+  else if ( _head != NO_LOOP && _node(_head).delta < next )
+    next = (_node(_head).delta > 1) ? _node(_head).delta : 1;
+
+  uint16_t compare = _deadline + (uint16_t) (next - 1) * TICK_COUNTS;
+
+  // Si ya paso (ej. tras un HIGH_PRIORITY extenso) se lo atiende cuanto antes
+  uint16_t count = TCNT1;
+  if ( (int16_t) (compare - count) < 2 )
+    compare = count + 2;
+
+  OCR1A = compare;
+  _programmed = 1 + (uint16_t) (compare - _deadline) / TICK_COUNTS;
+
+}
+#endif
+
+
+unsigned long AsynchLoop::missedTicks() {
+
+  char sreg = SREG;
+  cli();
+  unsigned long missed = _missedTicks;
+  SREG = sreg;
+
+  return missed;
+}
+#endif
+
 //
 
 #endif
@@ -0,0 +1,179 @@
+/*
+ * coroutine.cpp
+ * Copyright 2020 - Juan C. Bryksa (jcbryksa@gmail.com)
+ */
+
+#include "coroutine.hpp"
+
+Coroutine *Coroutine::_stalled = NULL;
+uint8_t Coroutine::_retrying = 0;
+
+// Reintentos desde loop(): alli attach dispone de los espacios reservados,
+// que el ISR repone antes que cualquier otro alta
+const AsynchLoop::Task Coroutine::_tasks[] PROGMEM = {
+  {_retry, NULL, 1, AsynchLoop::LOW_PRIORITY, 0}
+};
+
+
+Coroutine::Coroutine(Coroutine::Body body, AsynchLoop::Priority priority) {
+  _line = 0;
+  _delay = 0;
+  _body = body;
+  _priority = priority;
+  _loopId = INVALID_LOOP;
+  _nextStalled = NULL;
+}
+
+
+void Coroutine::start() {
+  stop();
+  _run();
+}
+
+
+void Coroutine::stop() {
+
+  // _retry (en el ISR) tambien escribe _loopId
+  char sreg = SREG;
+  cli();
+  AsyncLoop.detach(_loopId);
+  _loopId = INVALID_LOOP;
+  _unstall();
+  SREG = sreg;
+
+  _line = 0;
+}
+
+
+uint8_t Coroutine::running() {
+  return _line != 0;
+}
+
+
+uint8_t Coroutine::stalled() {
+
+  char sreg = SREG;
+  cli();
+  uint8_t stalled = 0;
+  for ( Coroutine *co = _stalled ; co ; co = co->_nextStalled )
+    stalled |= (co == this);
+  SREG = sreg;
+
+  return stalled;
+}
+
+
+/*
+ * Ejecuta un tramo del cuerpo y programa su reanudacion:
+ * tras CO_YIELD o CO_AWAIT en el tick siguiente y tras CO_DELAY
+ * al cumplirse la espera
+ */
+void Coroutine::_run() {
+
+  switch ( _body(this) ) {
+
+    case WAITING:
+      _schedule(1);
+      break;
+
+    case DELAYED:
+      _schedule(_delay);
+      break;
+
+    case ENDED:
+      break;
+  }
+
+}
+
+
+/*
+ * Programa la reanudacion; si AsyncLoop no tiene espacio (INVALID_LOOP) la
+ * agrega a las demoradas, con la espera pendiente en _delay
+ */
+void Coroutine::_schedule(unsigned int milliseconds) {
+
+  AsynchLoop::LoopId loopId = AsyncLoop.attach(_resume, this, milliseconds, AsynchLoop::ONE_TIME, _priority);
+
+  char sreg = SREG;
+  cli();
+
+  _loopId = loopId;
+
+  if ( loopId == INVALID_LOOP ) {
+    _delay = milliseconds;
+    _nextStalled = _stalled;
+    _stalled = this;
+    if ( ! _retrying )
+      _retrying = AsyncLoop.attach(_tasks);
+  }
+
+  SREG = sreg;
+
+}
+
+
+/*
+ * Quita la corrutina de las demoradas (con las interrupciones deshabilitadas)
+ */
+void Coroutine::_unstall() {
+
+  for ( Coroutine **link = &_stalled ; *link ; link = &(*link)->_nextStalled )
+    if ( *link == this ) {
+      *link = _nextStalled;
+      _nextStalled = NULL;
+      break;
+    }
+
+}
+
+
+/*
+ * Escaneo de 1 ms: reintenta programar las corrutinas demoradas
+ * descontando el tick transcurrido de su espera, y se quita al agotarlas
+ */
+void Coroutine::_retry(void *) {
+
+  // Las corrutinas de mayor prioridad se agregan a las demoradas desde el ISR
+  char sreg = SREG;
+  cli();
+
+  Coroutine **link = &_stalled;
+
+  while ( *link ) {
+
+    Coroutine *co = *link;
+
+    if ( co->_delay > 1 )
+      co->_delay--;
+
+    co->_loopId = AsyncLoop.attach(_resume, co, co->_delay, AsynchLoop::ONE_TIME, co->_priority);
+
+    if ( co->_loopId == INVALID_LOOP ) {
+      link = &co->_nextStalled;
+      continue;
+    }
+
+    *link = co->_nextStalled;
+    co->_nextStalled = NULL;
+  }
+
+  // Sin demoradas el escaneo se quita; _schedule lo vuelve a agregar
+  if ( ! _stalled ) {
+    AsyncLoop.detach(_tasks);
+    _retrying = 0;
+  }
+
+  SREG = sreg;
+
+}
+
+
+void Coroutine::_resume(void *coroutine) {
+
+  Coroutine *co = (Coroutine *) coroutine;
+
+  co->_loopId = INVALID_LOOP;
+  co->_run();
+
+}
@@ -4,56 +4,118 @@
  */
 
 #include "display.hpp"
+#include "elevator.hpp"
 
-const uint8_t * Display::pins;
-uint8_t Display::common;
-Display::Effect Display::_activeEffect = NONE;
 uint8_t Display::_value = 0;
 uint8_t Display::_effectStep = 0;
 uint8_t Display::_blinkCounter = 4;
 
+const AsynchLoop::Task Display::_tasks[] PROGMEM = {
+  {_playEffect, NULL, 70, AsynchLoop::LOW_PRIORITY, MAX_SLACK}
+};
+
+// Cada fila: el tick del efecto en curso y a continuacion la seleccion de cada efecto
+#define SELECT_EFFECT \
+  {NONE, _showValue}, {BLINK, _startBlink}, {RIGHT_ROTATION, _startRightRotation}, \
+  {LEFT_ROTATION, _startLeftRotation}, {SHIFT_UP, _startShift}, {SHIFT_DOWN, _startShift}
+
+const StateTransition Display::_transitions[EFFECTS][EVENTS] PROGMEM = {
+  //                     TICK                                   SELECT + efecto
+  /* NONE */           {IGNORED,                              SELECT_EFFECT},
+  /* BLINK */          {{BLINK, _blinkStep},                  SELECT_EFFECT},
+  /* RIGHT_ROTATION */ {{RIGHT_ROTATION, _rightRotationStep}, SELECT_EFFECT},
+  /* LEFT_ROTATION */  {{LEFT_ROTATION, _leftRotationStep},   SELECT_EFFECT},
+  /* SHIFT_UP */       {{SHIFT_UP, _shiftUpStep},             SELECT_EFFECT},
+  /* SHIFT_DOWN */     {{SHIFT_DOWN, _shiftDownStep},         SELECT_EFFECT},
+};
+
+Display::Machine Display::_machine(NONE);
+
+const uint8_t Display::_digits[] PROGMEM = {
+ //-gfedcba
+  B00111111, //0
+  B00000110, //1
+  B01011011, //2
+  B01001111, //3
+  B01100110, //4
+  B01101101, //5
+  B01111101, //6
+  B00000111, //7
+  B01111111, //8
+  B01101111, //9
+};
+
+const uint8_t Display::_shiftUp[] PROGMEM = {
+ //-gfedcba
+  B00001000, //0
+  B01000000, //1
+  B00000001, //2
+};
+
+const uint8_t Display::_shiftDown[] PROGMEM = {
+ //-gfedcba
+  B00000001, //0
+  B01000000, //1
+  B00001000, //2
+};
+
 void Display::_setSegment(uint8_t segment) {
-  digitalWrite(pins[segment], (common==LOW)? HIGH : LOW);
+  digitalWrite(Station::displayPins[segment], (Station::DISPLAY_COMMON==LOW)? HIGH : LOW);
 }
 
 
 void Display::_clearSegment(uint8_t segment) {
-  digitalWrite(pins[segment], (common==LOW)? LOW : HIGH);
+  digitalWrite(Station::displayPins[segment], (Station::DISPLAY_COMMON==LOW)? LOW : HIGH);
 }
 
 
-void Display::init(const uint8_t *displayPins, uint8_t commonPinLevel) {
-
-  common = commonPinLevel;
-  pins = displayPins;
+void Display::init() {
 
-  for ( int i = 0 ; i < 7 ; i++ ) {
-    pinMode(pins[i], OUTPUT);
+  for ( uint8_t i = 0 ; i < 7 ; i++ ) {
+    pinMode(Station::displayPins[i], OUTPUT);
     _clearSegment(i);
   }
 
-  setInterval(_playEffect, 70);
+  AsyncLoop.attach(_tasks);
+
+  EventBus::subscribe(EventBus::ELEVATOR_REQUESTED, _elevatorRequested);
+  EventBus::subscribe(EventBus::ELEVATOR_ARRIVED, _elevatorArrived);
 
 }
 
 
+/**
+ * Efecto durante el recorrido: desplazamiento segun el sentido, o rotacion
+ * si parte entre pisos en un sentido desconocido
+ */
+void Display::_elevatorRequested(uint8_t value) {
+
+  switch ( value >> 4 ) {
+    case Elevator::UP:
+      effect(SHIFT_UP);
+      break;
+    case Elevator::DOWN:
+      effect(SHIFT_DOWN);
+      break;
+    default:
+      effect(RIGHT_ROTATION);
+  }
+
+}
+
+
+/**
+ * Al concluir el recorrido muestra el piso alcanzado
+ */
+void Display::_elevatorArrived(uint8_t floor) {
+  clearEffect();
+  show(floor + 1);
+}
+
+
 void Display::show(uint8_t value) {
 
-  const uint8_t numbers[] = {
-   //-gfedcba
-    B00111111, //0
-    B00000110, //1
-    B01011011, //2
-    B01001111, //3
-    B01100110, //4
-    B01101101, //5
-    B01111101, //6
-    B00000111, //7
-    B01111111, //8
-    B01101111, //9
-  };
-
-  _setSegmentsByte(numbers[value]);
+  _setSegmentsByte(pgm_read_byte(&_digits[value]));
 
   _value = value;
 
@@ -64,7 +126,7 @@ void Display::_setSegmentsByte(uint8_t value) {
 
   uint8_t mask = 0x01;
 
-  for ( int i = 0 ; i < 7 ; i++ ) {
+  for ( uint8_t i = 0 ; i < 7 ; i++ ) {
     if ( (value & mask) )
       _setSegment(i);
     else
@@ -76,127 +138,121 @@ void Display::_setSegmentsByte(uint8_t value) {
 }
 
 
-void Display::_playEffect() {
-
-  switch(_activeEffect) {
-
-    case NONE: break;
+void Display::_playEffect(void *) {
+  _machine.dispatch(TICK);
+}
 
-    case BLINK: {
 
-      if (!_blinkCounter) {
-        if (_effectStep) {
-          _setSegmentsByte(0);
-          _effectStep = 0;
-        } else {
-          show(_value);
-          _effectStep = 1;
-        }
-        _blinkCounter = 4;
-      }
-      else
-        _blinkCounter--;
+void Display::_blinkStep() {
 
-      break;
+  if (!_blinkCounter) {
+    if (_effectStep) {
+      _setSegmentsByte(0);
+      _effectStep = 0;
+    } else {
+      show(_value);
+      _effectStep = 1;
     }
+    _blinkCounter = 4;
+  }
+  else
+    _blinkCounter--;
 
-    case RIGHT_ROTATION: {
+}
 
-      if (_effectStep == B01000000)
-        _effectStep = B00000001;
 
-      _setSegmentsByte(_effectStep);
+void Display::_rightRotationStep() {
 
-      _effectStep <<=1;
+  if (_effectStep == B01000000)
+    _effectStep = B00000001;
 
-      break;
-    }
+  _setSegmentsByte(_effectStep);
 
-    case LEFT_ROTATION: {
+  _effectStep <<=1;
 
-      if (_effectStep == 0)
-        _effectStep = B0100000;
+}
 
-      _setSegmentsByte(_effectStep);
 
-      _effectStep >>=1;
+void Display::_leftRotationStep() {
 
-      break;
-    }
+  if (_effectStep == 0)
+    _effectStep = B0100000;
 
-    case SHIFT_UP:
-    case SHIFT_DOWN: {
+  _setSegmentsByte(_effectStep);
 
-      const uint8_t up[] = {
-       //-gfedcba
-        B00001000, //0
-        B01000000, //1
-        B00000001, //2
-      };
-      const uint8_t down[] = {
-       //-gfedcba
-        B00000001, //0
-        B01000000, //1
-        B00001000, //2
-      };
+  _effectStep >>=1;
 
-      if (!_blinkCounter) {
+}
 
-        if (_effectStep == 3)
-          _effectStep = 0;
 
-        if ( _activeEffect == SHIFT_UP )
-          _setSegmentsByte(up[_effectStep]);
-        else
-          _setSegmentsByte(down[_effectStep]);
+void Display::_shiftStep(const uint8_t *sequence) {
 
-        _effectStep++;
+  if (!_blinkCounter) {
 
-        _blinkCounter = 2;
-      }
-      else
-        _blinkCounter--;
+    if (_effectStep == 3)
+      _effectStep = 0;
 
-      break;
-    }
+    _setSegmentsByte(pgm_read_byte(&sequence[_effectStep]));
 
+    _effectStep++;
+
+    _blinkCounter = 2;
   }
+  else
+    _blinkCounter--;
+
+}
+
 
+void Display::_shiftUpStep() {
+  _shiftStep(_shiftUp);
+}
+
+
+void Display::_shiftDownStep() {
+  _shiftStep(_shiftDown);
+}
+
+
+void Display::_showValue() {
+  show(_value);
+}
+
+
+void Display::_startBlink() {
+  _effectStep = 1;
+}
+
+
+void Display::_startRightRotation() {
+  _effectStep = B00000001;
+}
+
+
+void Display::_startLeftRotation() {
+  _effectStep = B00100000;
+}
+
+
+void Display::_startShift() {
+  _effectStep = 0;
 }
 
 
 void Display::effect(Display::Effect effect) {
 
-  _activeEffect = effect;
+  TRACE(DISPLAY_EFFECT, effect);
 
-  switch(_activeEffect) {
-    case NONE: {
-      show(_value);
-      break;
-    }
-    case BLINK: {
-      _effectStep = 1;
-      break;
-    }
-    case RIGHT_ROTATION: {
-      _effectStep = B00000001;
-      break;
-    }
-    case LEFT_ROTATION: {
-      _effectStep = B00100000;
-      break;
-    }
-    case SHIFT_UP:
-    case SHIFT_DOWN: {
-      _effectStep = 0;
-      break;
-    }
-  }
+  _machine.dispatch(SELECT + effect);
 
 }
 
 
 void Display::clearEffect() {
-  _activeEffect = NONE;
-  show(_value);
+  effect(NONE);
+}
+
+
+uint8_t Display::idle() {
+  return _machine.state() == NONE;
 }
@@ -5,83 +5,178 @@
 
 #include "elevator.hpp"
 
-const uint8_t * Elevator::_floorPins;
-uint8_t Elevator::_floors;
-uint8_t Elevator::_enginePinA;
-uint8_t Elevator::_enginePinB;
-uint8_t Elevator::_buzzerPin;
 uint8_t Elevator::_pwmValue;
 uint8_t Elevator::_currentFloor;
 uint8_t Elevator::_goToFloor;
 Elevator::Direction Elevator::_currentMovement;
-void (*Elevator::_endCallback)(uint8_t);
-Elevator::Status Elevator::_status;
-
-
-void Elevator::init(const uint8_t *floorPins, const uint8_t floors, const uint8_t enginePinA,
-                    const uint8_t enginePinB, const uint8_t buzzerPin, void (*endCallback)(uint8_t) ) {
-
-  _floorPins  = floorPins;
-  _floors     = floors;
-  _enginePinA = enginePinA;
-  _enginePinB = enginePinB;
-  _buzzerPin  = buzzerPin;
-
-  _pwmValue = 200;         // no utilizado en la logica actualmente programada
+uint8_t Elevator::_lastFloor = NO_FLOOR;
+Elevator::Direction Elevator::_tripDirection = NONE;
+unsigned long Elevator::_bootTime = 0;
+uint8_t Elevator::_buzzing = OFF;
+AsynchLoop::LoopId Elevator::_buzzerLoop = INVALID_LOOP;
+
+// Recorridos: cada escaneo despacha REQUESTED y AT_TARGET segun el piso solicitado,
+// y la corrutina de partida CALLED y DEPARTED
+const StateTransition Elevator::_transitions[STATES][EVENTS] PROGMEM = {
+  //             REQUESTED         AT_TARGET          CALLED             DEPARTED
+  /* READY */   {{BUSY, _depart},  IGNORED,           {WAITING, _beep},  IGNORED},
+  /* BUSY */    {IGNORED,          {READY, _arrive},  IGNORED,           IGNORED},
+  /* WAITING */ {IGNORED,          IGNORED,           IGNORED,           {READY, NULL}},
+  /* ERROR */   {IGNORED,          IGNORED,           IGNORED,           IGNORED},
+};
+
+Elevator::Machine Elevator::_machine(READY);
+
+// Escaneo ciclico (camino critico: finales de carrera y motor), solo durante
+// un recorrido, la espera previa o el frenado: en reposo se quita a si mismo
+// y goTo lo vuelve a agregar
+const AsynchLoop::Task Elevator::_tasks[] PROGMEM = {
+  {_scan, NULL, 1, AsynchLoop::CRITICAL, 0}
+};
+
+Coroutine Elevator::_departure(_departureSequence);
+Coroutine Elevator::_braking(_brakeSequence, AsynchLoop::CRITICAL); // controla el motor
+
+
+void Elevator::init() {
+
+  _pwmValue = 200;         // ciclo de trabajo del motor (PWM por hardware del Timer1)
   _goToFloor = NO_FLOOR;   // ningun piso solicitado
-  _currentMovement = NONE; // ningun movimiento actual
-  _endCallback = NULL;     // ningun callback de finalizacion de recorrido
-  _status = READY;         // estado actual = listo
+  _currentMovement = NONE; // ningun movimiento actual (estado inicial: listo)
 
   /* Inicializa cada uno de los pines
    * correspondiente a los switches de
    * final de carrera de cada piso
    */
-  for ( int i = 0 ; i < _floors ; i++ )
-    pinMode(_floorPins[i], INPUT_PULLUP);
+  for ( uint8_t i = 0 ; i < Station::FLOORS ; i++ )
+    pinMode(Station::floors[i].limitSwitch, INPUT_PULLUP);
 
   // Inicializa los pines de salida (motor y buzzer)
-  pinMode(_enginePinA, OUTPUT);
-  pinMode(_enginePinB, OUTPUT);
-  pinMode(_buzzerPin, OUTPUT);
+  pinMode(Station::ENGINE_PIN_A, OUTPUT);
+  pinMode(Station::ENGINE_PIN_B, OUTPUT);
+  pinMode(Station::BUZZER_PIN, OUTPUT);
 
   // Verifica en que piso esta actualmente
   _checkCurrentFloor();
 
-  // Si tiene seteada una funcion de final de recorrido la ejecuta
-  if ( endCallback )
-    _endCallback = endCallback;
-
-  // Establece el escaneo ciclico
-  setInterval(_scan, 1);
+  // Establece el escaneo ciclico (hasta el primer reposo)
+  AsyncLoop.attach(_tasks);
 
 }
 
 
-void Elevator::goTo(uint8_t floor, void (*endCallback)(uint8_t) ) {
+void Elevator::goTo(uint8_t floor, uint8_t wait) {
+
+  TRACE(GO_TO, floor);
+
+  // Primero la espera: con el piso ya solicitado el escaneo partiria en READY
+  if ( wait == ON )
+    _departure.start();
 
   _goToFloor = floor;
 
-  _status = WAITING;
+  // Entre pisos sin referencia alguna (arranque sin Journal) solo se lo
+  // envia al primer piso, necesariamente hacia abajo
+  Direction course = NONE;
+  if ( _currentFloor != NO_FLOOR )
+    course = (floor < _currentFloor) ? DOWN : UP;
+  else if ( _lastFloor == NO_FLOOR && floor == 0 )
+    course = DOWN;
+
+  EventBus::post(EventBus::ELEVATOR_REQUESTED, (course << 4) | floor);
+
+  // Con el piso ya solicitado: el escaneo no puede quitarse antes de verlo
+  AsyncLoop.attach(_tasks);
+
+}
+
+
+void Elevator::restore(uint8_t lastFloor, Elevator::Direction direction) {
+  // Un registro de otra estacion (con mas pisos) no se considera
+  _lastFloor = (lastFloor < Station::FLOORS) ? lastFloor : NO_FLOOR;
+  _tripDirection = direction;
+}
+
+
+/*
+ * Parte hacia el piso solicitado: sube o baja en funcion del piso actual
+ */
+void Elevator::_depart() {
+
+  Direction heading = _heading();
+
+  if ( heading != NONE )
+    _move(heading);
+
+  _tripDirection = _currentMovement;
+
+}
+
+
+/*
+ * Sentido hacia el piso solicitado. Entre pisos, si se conoce el recorrido
+ * interrumpido, la cabina paso el ultimo piso en ese sentido (medio piso):
+ * subiendo esta sobre el, bajando debajo (ej. bajo el primer piso, con el
+ * final de carrera ya liberado, debe subir para volver a el)
+ */
+Elevator::Direction Elevator::_heading() {
+
+  if ( _currentFloor != NO_FLOOR )
+    return (_goToFloor > _currentFloor) ? UP : (_goToFloor < _currentFloor) ? DOWN : NONE;
+
+  if ( _lastFloor != NO_FLOOR && _tripDirection == UP )
+    return (_goToFloor > _lastFloor) ? UP : DOWN;
+
+  if ( _lastFloor != NO_FLOOR && _tripDirection == DOWN )
+    return (_goToFloor >= _lastFloor) ? UP : DOWN;
+
+  // Sin referencia: baja hacia el primer piso, sube hacia el ultimo
+  return (_goToFloor == 0) ? DOWN : UP;
+
+}
+
+
+/*
+ * Llegada al piso solicitado: aplica el freno (movimiento inverso durante
+ * unos pocos milisegundos) y queda nuevamente disponible
+ */
+void Elevator::_arrive() {
+
+  _brake();
+
+  // Resetea: establece que el nuevo piso solicitado es ninguno
+  _goToFloor = NO_FLOOR;
+  _tripDirection = NONE;
+
+  // Se atiende desde loop(): este escaneo se ejecuta dentro del ISR
+  EventBus::post(EventBus::ELEVATOR_ARRIVED, _currentFloor);
+
+}
+
+
+Coroutine::Result Elevator::_departureSequence(Coroutine *co) {
+
+  CO_BEGIN(co);
+
+  // Hace sonar el buzzer
+  _machine.dispatch(CALLED);
 
   /* Posterga el estado ready para que el ascensor
    * permanezca inmovil un tiempo y luego
    * avance hacia el piso solicitado
    */
-  setTimeout(_setReady, WAIT_TIME);
+  CO_DELAY(co, WAIT_TIME);
 
-  // Establece la funcion callback si se paso por argumento
-  if ( endCallback )
-    _endCallback = endCallback;
-  
-  // Hace sonar el buzzer
-  _beep();
+  _machine.dispatch(DEPARTED);
+  TRACE(READY, _currentFloor);
+
+  CO_END(co);
 
 }
 
 
 Elevator::Status Elevator::status() {
-  return _status;
+  return (Status) _machine.state();
 }
 
 
@@ -90,58 +185,116 @@ uint8_t Elevator::floor() {
 }
 
 
+uint8_t Elevator::lastFloor() {
+  return _lastFloor;
+}
+
+
+Elevator::Direction Elevator::direction() {
+  return _tripDirection;
+}
+
+
+uint8_t Elevator::target() {
+  return _goToFloor;
+}
+
+
+unsigned long Elevator::bootTime() {
+
+  char sreg = SREG;
+  cli();
+  unsigned long bootTime = _bootTime;
+  SREG = sreg;
+
+  return bootTime;
+}
+
+
+uint8_t Elevator::idle() {
+  return _machine.state() == READY && _currentMovement == NONE && _goToFloor == NO_FLOOR;
+}
+
+
 void Elevator::_playBuzzer() {
-  digitalWrite(_buzzerPin, ! digitalRead(_buzzerPin));
+  digitalWrite(Station::BUZZER_PIN, ! digitalRead(Station::BUZZER_PIN));
 }
 
 
-void Elevator::_setReady() {
-  _status = READY;
+void Elevator::_beep() {
+  _buzzer(ON);
 }
 
 
-void Elevator::_beep(uint8_t status) {
+void Elevator::_buzzer(uint8_t status) {
 
-  static AsynchLoop::LoopId loopId; // id correspondiente al ciclo "beep"
+  AsynchLoop::LoopId loopId = INVALID_LOOP;
 
   if ( status == ON )
-    loopId = setInterval(_playBuzzer, BUZZER_PERIOD);
-  else {
-    clearInterval(loopId);
-    digitalWrite(_buzzerPin, LOW);
+    loopId = AsyncLoop.attach(_playBuzzer, BUZZER_PERIOD, AsynchLoop::CYCLIC, AsynchLoop::HIGH_PRIORITY);
+
+  // _scan (en el ISR) tambien lee y reintenta el ciclo "beep"
+  char sreg = SREG;
+  cli();
+
+  if ( status == OFF ) {
+    clearInterval(_buzzerLoop);
+    digitalWrite(Station::BUZZER_PIN, LOW);
   }
 
+  _buzzerLoop = loopId;   // INVALID_LOOP si no quedaba espacio: _scan reintenta
+  _buzzing = status;
+
+  SREG = sreg;
+
 }
 
 
 void Elevator::_move(Elevator::Direction direction) {
 
   _currentMovement = direction;
+  TRACE(MOTOR_START, direction);
 
   // Giro del motor para movimiento ascendente
+  // (con el Timer1 ocupado por AsynchLoop no hay PWM y se lo maneja a pleno)
   if ( direction == UP ) {
-    //analogWrite(_enginePinA, _pwmValue);
-    digitalWrite(_enginePinA, HIGH);
-    digitalWrite(_enginePinB, LOW);
+    digitalWrite(Station::ENGINE_PIN_B, LOW);
+#if ASYNC_LOOP_TIMER == 1
+    digitalWrite(Station::ENGINE_PIN_A, HIGH);
+#else
+    analogWrite(Station::ENGINE_PIN_A, _pwmValue);
+#endif
   }
   else if ( direction == DOWN ) { // giro para movimiento descendente
-    digitalWrite(_enginePinA, LOW);
-    digitalWrite(_enginePinB, HIGH);
-    //analogWrite(_enginePinB, _pwmValue);
+    digitalWrite(Station::ENGINE_PIN_A, LOW);
+#if ASYNC_LOOP_TIMER == 1
+    digitalWrite(Station::ENGINE_PIN_B, HIGH);
+#else
+    analogWrite(Station::ENGINE_PIN_B, _pwmValue);
+#endif
   }
 
 }
 
 
 void Elevator::_stop() {
+  TRACE(STOP, _currentFloor);
   _currentMovement = NONE;
-  digitalWrite(_enginePinA, LOW);
-  digitalWrite(_enginePinB, LOW);
-  _beep(OFF);
+  digitalWrite(Station::ENGINE_PIN_A, LOW);
+  digitalWrite(Station::ENGINE_PIN_B, LOW);
+  _buzzer(OFF);
 }
 
 
 void Elevator::_brake() {
+  TRACE(BRAKE, _currentMovement);
+  _braking.start();
+}
+
+
+Coroutine::Result Elevator::_brakeSequence(Coroutine *co) {
+
+  CO_BEGIN(co);
 
   // Establece un movimiento inverso
   if ( _currentMovement == UP )
@@ -150,7 +303,12 @@ void Elevator::_brake() {
     _move(UP);
 
   // Mantiene ese movimiento inverso durante algunos milisegundos
-  setTimeout(_stop, BRAKE_TIME);
+  CO_DELAY(co, BRAKE_TIME);
+
+  _stop();
+
+  CO_END(co);
+
 }
 
 
@@ -159,62 +317,59 @@ void Elevator::_checkCurrentFloor() {
   _currentFloor = NO_FLOOR;
 
   // Escanea el estado de los switches final de carrera de cada piso
-  for ( int i = 0 ; i < _floors ; i++ )
-    if ( digitalRead(_floorPins[i]) == LOW ) {
+  for ( uint8_t i = 0 ; i < Station::FLOORS ; i++ )
+    if ( RECORD_INPUT(Station::floors[i].limitSwitch, digitalRead(Station::floors[i].limitSwitch)) == LOW ) {
       _currentFloor = i;
+      _lastFloor = i;
       break;
     }
 
+#if TRACE_ENABLED
+  static uint8_t switchFloor = NO_FLOOR;   // ultimo piso registrado por los finales de carrera
+  if ( _currentFloor != switchFloor ) {
+    TRACE(LIMIT_SWITCH, _currentFloor);
+    switchFloor = _currentFloor;
+  }
+#endif
+
 }
 
 
-void Elevator::_scan() {
+void Elevator::_scan(void *) {
 
   // Verifica cual es el piso actual (si es entre pisos determina NO_FLOOR)
   _checkCurrentFloor();
 
-  // Si se ha solicitado ir a algun piso  y ademas 
-  // el ascensor se encuetra detenido (movimiento NONE) entre pisos (piso NO_FLOOR)
-  if ( _goToFloor != NO_FLOOR && _currentFloor == NO_FLOOR && _currentMovement == NONE ) {
-    if ( _goToFloor == 0 ) // si se pide el primer piso
-      _currentFloor = 1;
-    else if ( _goToFloor == (_floors - 1) ) // si se pide el ultimo
-      _currentFloor = 0;
-    else {  // ninguno de los anteriores (alguno del medio), manda al primero
-      _currentFloor = 1;
-      _goToFloor = 0;
-    }
-  }
+  // Si se ha solicitado ir a algun piso del medio y ademas el ascensor se
+  // encuentra detenido entre pisos (piso NO_FLOOR) sin conocerse el recorrido
+  // interrumpido, lo manda al primero (el sentido lo determina _heading)
+  if ( _goToFloor != NO_FLOOR && _currentFloor == NO_FLOOR && _currentMovement == NONE &&
+       (_lastFloor == NO_FLOOR || _tripDirection == NONE) &&
+       _goToFloor != 0 && _goToFloor != (Station::FLOORS - 1) )
+    _goToFloor = 0;
   //
 
-  // Si el ascensor se encuentra detenido y se ha solicitado ir a algun piso
-  if ( _currentMovement == NONE && _goToFloor != NO_FLOOR  && _status == READY ) {
+  // Detenido y con algun piso solicitado: parte (solo si esta listo)
+  if ( _goToFloor != NO_FLOOR && _currentMovement == NONE )
+    _machine.dispatch(REQUESTED);
 
-    // Determina si subir o bajar en funcion del piso actual y el solicitado
-    if ( _goToFloor > _currentFloor )
-      _move(UP);
-    else if ( _goToFloor < _currentFloor )
-      _move(DOWN);
-
-    _status = BUSY;
-  }
-  //
+  // Llegada al piso solicitado (solo durante un recorrido)
+  if ( _goToFloor == _currentFloor && _currentFloor != NO_FLOOR )
+    _machine.dispatch(AT_TARGET);
 
-  // Detiene el ascensor cuando este ha llegado al piso solicitado
-  if ( _goToFloor == _currentFloor && _currentFloor != NO_FLOOR && _status == BUSY ) {
+  // Sin espacio al comenzar el beep: reintenta en cada escaneo
+  if ( _buzzing == ON && _buzzerLoop == INVALID_LOOP )
+    _buzzerLoop = AsyncLoop.attach(_playBuzzer, BUZZER_PERIOD, AsynchLoop::CYCLIC, AsynchLoop::HIGH_PRIORITY);
 
-    // Aplica el freno (movimiento inverso durante unos pocos milisegundos)
-    _brake();
-
-    // Resetea: establece que el nuevo piso solicitado es ninguno
-    _goToFloor = NO_FLOOR;
-
-    if ( _endCallback )
-      _endCallback(_currentFloor);
-
-    // De nuevo vuelve a estar disponible
-    _status = READY;
+  // Tiempo de arranque: primera vez listo y detenido en un piso
+  if ( ! _bootTime && _currentFloor != NO_FLOOR && idle() ) {
+    _bootTime = millis();
+    if ( ! _bootTime )
+      _bootTime = 1;
   }
-  //
+
+  // En reposo los finales de carrera no se leen (como en power-down)
+  if ( idle() )
+    AsyncLoop.detach(_tasks);
 
 }
@@ -0,0 +1,89 @@
+/*
+ * event-bus.cpp
+ * Copyright 2020 - Juan C. Bryksa (jcbryksa@gmail.com)
+ */
+
+#include "event-bus.hpp"
+
+volatile EventBus::Event EventBus::_events[EVENT_QUEUE_SIZE];
+volatile uint8_t EventBus::_head = 0;
+volatile uint8_t EventBus::_tail = 0;
+volatile uint8_t EventBus::_dropped = 0;
+EventBus::Subscriber EventBus::_subscribers[MAX_SUBSCRIBERS];
+uint8_t EventBus::_subscriberCount = 0;
+
+
+uint8_t EventBus::post(EventBus::EventType type, uint8_t value) {
+
+  // Reserva el lugar en una seccion critica breve (un ISR puede publicar en
+  // medio de otra publicacion)
+  char sreg = SREG;
+  cli();
+
+  if ( (uint8_t) (_head - _tail) == EVENT_QUEUE_SIZE ) {
+    if ( _dropped < 255 )
+      _dropped++;
+    SREG = sreg;
+    return 0;
+  }
+
+  volatile Event &event = _events[_head & (EVENT_QUEUE_SIZE - 1)];
+  _head++;
+
+  SREG = sreg;
+
+  // La escritura ya no necesita exclusion: el lugar es propio hasta publicarlo
+  event.type = type;
+  event.value = value;
+  event.ready = 1;
+
+  return 1;
+}
+
+
+uint8_t EventBus::subscribe(EventBus::EventType type, void (*handler)(uint8_t)) {
+
+  if ( _subscriberCount == MAX_SUBSCRIBERS )
+    return 0;
+
+  _subscribers[_subscriberCount].type = type;
+  _subscribers[_subscriberCount].handler = handler;
+  _subscriberCount++;
+
+  return 1;
+}
+
+
+void EventBus::dispatch() {
+
+  // Un lugar reservado aun sin publicar solo puede pertenecer a un ISR
+  // interrumpido, que concluye antes de volver a loop(); no se lo saltea
+  // para mantener el orden de publicacion
+  while ( _tail != _head ) {
+
+    volatile Event &event = _events[_tail & (EVENT_QUEUE_SIZE - 1)];
+
+    if ( ! event.ready )
+      break;
+
+    uint8_t type = event.type;
+    uint8_t value = event.value;
+    event.ready = 0;
+    _tail++;                        // libera el lugar
+
+    for ( uint8_t i = 0 ; i < _subscriberCount ; i++ )
+      if ( _subscribers[i].type == type )
+        _subscribers[i].handler(value);
+  }
+
+}
+
+
+uint8_t EventBus::pending() {
+  return _tail != _head;
+}
+
+
+uint8_t EventBus::dropped() {
+  return _dropped;
+}
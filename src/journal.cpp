@@ -0,0 +1,135 @@
+/*
+ * journal.cpp
+ * Copyright 2020 - Juan C. Bryksa (jcbryksa@gmail.com)
+ */
+
+#include "journal.hpp"
+
+#if JOURNAL_ENABLED
+
+#include "elevator.hpp"
+#include "event-bus.hpp"
+
+void (*Journal::_snapshot)(Journal::State &) = NULL;
+Journal::State Journal::_state;
+Journal::Record Journal::_record;
+uint8_t Journal::_slot = 0;
+uint8_t Journal::_written = sizeof(Journal::Record);
+uint8_t Journal::_dirty = 0;
+
+
+uint8_t Journal::init(void (*snapshot)(Journal::State &)) {
+
+  _snapshot = snapshot;
+
+  // Busca el ultimo registro valido de la secuencia
+  uint8_t found = 0;
+  uint8_t sequence = 0;
+  Record record;
+
+  for ( uint8_t slot = 0 ; slot < JOURNAL_SLOTS ; slot++ ) {
+
+    eeprom_read_block(&record, _address(slot), sizeof(Record));
+
+    if ( record.crc != _crc(record) )
+      continue;
+
+    if ( ! found || (uint8_t) (record.sequence - sequence) < JOURNAL_SLOTS ) {
+      found = 1;
+      sequence = record.sequence;
+      _state = record.state;
+      _slot = (slot + 1) % JOURNAL_SLOTS;
+    }
+  }
+
+  if ( ! found ) {
+    _state.floor = NO_FLOOR;
+    _state.direction = 0;
+    _state.target = NO_FLOOR;
+    _state.changeType = 0;
+    _state.trips = 0;
+    _state.boots = 0;
+    sequence = 0xFF;               // el primer registro tendra secuencia 0
+  }
+
+  _record.sequence = sequence;
+  _state.boots++;
+  _dirty = 1;
+
+  EventBus::subscribe(EventBus::ELEVATOR_ARRIVED, _tripEnded);
+
+  return found;
+}
+
+
+const Journal::State &Journal::state() {
+  return _state;
+}
+
+
+void Journal::poll() {
+
+  // Compara el estado de la estacion con el vigente
+  if ( _snapshot ) {
+    State current = _state;
+    _snapshot(current);
+    if ( memcmp(&current, &_state, sizeof(State)) ) {
+      _state = current;
+      _dirty = 1;
+    }
+  }
+
+  // Comienza un registro nuevo con el ultimo estado
+  if ( _written == sizeof(Record) ) {
+    if ( ! _dirty )
+      return;
+    _record.sequence++;
+    _record.state = _state;
+    _record.crc = _crc(_record);
+    _written = 0;
+    _dirty = 0;
+  }
+
+  // Un byte por vez, sin esperar a que la EEPROM termine el anterior
+  if ( ! eeprom_is_ready() )
+    return;
+
+  eeprom_update_byte((uint8_t *) _address(_slot) + _written, ((uint8_t *) &_record)[_written]);
+
+  if ( ++_written == sizeof(Record) )
+    _slot = (_slot + 1) % JOURNAL_SLOTS;
+}
+
+
+uint8_t Journal::busy() {
+  return _dirty || _written < sizeof(Record) || ! eeprom_is_ready();
+}
+
+
+/*
+ * CRC-8 de la secuencia y el estado; el valor inicial distingue el
+ * formato (y hace invalido un registro borrado, todo 0xFF)
+ */
+uint8_t Journal::_crc(const Journal::Record &record) {
+
+  uint8_t crc = JOURNAL_VERSION;
+  const uint8_t *bytes = (const uint8_t *) &record;
+
+  for ( uint8_t i = 0 ; i < offsetof(Record, crc) ; i++ )
+    crc = _crc8_ccitt_update(crc, bytes[i]);
+
+  return crc;
+}
+
+
+Journal::Record *Journal::_address(uint8_t slot) {
+  return (Record *) (JOURNAL_ADDRESS + slot * sizeof(Record));
+}
+
+
+void Journal::_tripEnded(uint8_t) {
+  _state.trips++;
+  _dirty = 1;
+}
+
+#endif
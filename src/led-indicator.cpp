@@ -5,41 +5,41 @@
 
 #include "led-indicator.hpp"
 
-const uint8_t * LedIndicator::_pins;
-uint8_t LedIndicator::_quantity;
-LedIndicator::LedStatus LedIndicator::_status[MAX_LEDS];
-uint8_t LedIndicator::_common;
+LedIndicator::LedStatus LedIndicator::_status[Station::LEDS];
 
+// Ciclos de blink con velocidades baja, media y alta, atendidos por el mismo handler
+// Alineados a sus periodos: cada 200 ms un mismo tick atiende al medio y al rapido
+// (y cada 800 ms tambien al lento), por lo que los leds conmutan en fase
+const AsynchLoop::Task LedIndicator::_blinkTasks[] PROGMEM = {
+  {_blink, (void *) BLINK_SLOW,   800, AsynchLoop::LOW_PRIORITY, MAX_SLACK},
+  {_blink, (void *) BLINK_MEDIUM, 200, AsynchLoop::LOW_PRIORITY, MAX_SLACK},
+  {_blink, (void *) BLINK_FAST,   100, AsynchLoop::LOW_PRIORITY, MAX_SLACK}
+};
 
-void LedIndicator::init(const uint8_t *ledIndicatorPins, uint8_t quantity, uint8_t commonPinLevel) {
 
-  _common = commonPinLevel;
-  _pins = ledIndicatorPins;
-  _quantity = quantity;
+void LedIndicator::init() {
 
   // Inicializa cada uno de los pines de leds
-  for ( int i = 0 ; i < _quantity ; i++ ) {
-    pinMode(_pins[i], OUTPUT);
-    digitalWrite(_pins[i], _common);
+  for ( uint8_t i = 0 ; i < Station::LEDS ; i++ ) {
+    pinMode(Station::ledPins[i], OUTPUT);
+    digitalWrite(Station::ledPins[i], Station::LED_COMMON);
   }
 
   // Establece cada ciclo para blick con velocidades baja, media y alta
-  AsyncLoop.attach(_blinkSlow, 800);
-  AsyncLoop.attach(_blinkMedium, 200);
-  AsyncLoop.attach(_blinkFast, 100);
+  AsyncLoop.attach(_blinkTasks);
 
 }
 
 
 void LedIndicator::on(uint8_t ind) {
   _status[ind] = ON;
-  digitalWrite(_pins[ind], !_common);
+  digitalWrite(Station::ledPins[ind], !Station::LED_COMMON);
 }
 
 
 void LedIndicator::off(uint8_t ind) {
   _status[ind] = OFF;
-  digitalWrite(_pins[ind], _common);
+  digitalWrite(Station::ledPins[ind], Station::LED_COMMON);
 }
 
 
@@ -50,10 +50,10 @@ void LedIndicator::blink(uint8_t ind, LedIndicator::LedStatus blinkStatus) {
 
 uint8_t LedIndicator::toggle(uint8_t ind) {
 
-  uint8_t status = !digitalRead(_pins[ind]);
-  digitalWrite(_pins[ind], status);
+  uint8_t status = !digitalRead(Station::ledPins[ind]);
+  digitalWrite(Station::ledPins[ind], status);
 
-  if(_common)
+  if(Station::LED_COMMON)
     status = !status;
 
   _status[ind] = (status)? ON : OFF;
@@ -62,30 +62,25 @@ uint8_t LedIndicator::toggle(uint8_t ind) {
 }
 
 
-void LedIndicator::_blink(LedIndicator::LedStatus blinkStatus) {
+void LedIndicator::_blink(void *blinkStatus) {
 
-  for ( int i = 0 ; i < _quantity ; i++ )
-    if ( _status[i] == blinkStatus )
-      digitalWrite(_pins[i], !digitalRead(_pins[i]));
+  for ( uint8_t i = 0 ; i < Station::LEDS ; i++ )
+    if ( _status[i] == (LedStatus) (uintptr_t) blinkStatus )
+      digitalWrite(Station::ledPins[i], !digitalRead(Station::ledPins[i]));
 
 }
 
 
-void LedIndicator::_blinkSlow() {
-  _blink(BLINK_SLOW);
-}
-
-
-void LedIndicator::_blinkMedium() {
-  _blink(BLINK_MEDIUM);
+LedIndicator::LedStatus LedIndicator::read(uint8_t ind) {
+  return _status[ind];
 }
 
 
-void LedIndicator::_blinkFast() {
-  _blink(BLINK_FAST);
-}
+uint8_t LedIndicator::idle() {
 
+  for ( uint8_t i = 0 ; i < Station::LEDS ; i++ )
+    if ( _status[i] >= BLINK_SLOW )
+      return 0;
 
-LedIndicator::LedStatus LedIndicator::read(uint8_t ind) {
-  return _status[ind];
+  return 1;
 }
@@ -5,19 +5,42 @@
 
 #include "light.hpp"
 
-Adafruit_NeoPixel * Light::_pixels = NULL;
-Light::Zone Light::_zones[TOTAL_ZONES] = {{0,12}, {13,25}, {26,38}};
-Light::Scene Light::_scene = NONE;
-uint32_t Light::_step = 0;
+NeoPixelStrip<Station::PIXELS> Light::_pixels(NEO_GRB + NEO_KHZ800);
+uint16_t Light::_step = 0;
 uint8_t Light::_intervalScaler = SCALER_SLOW_SPEED;
 uint8_t Light::_intervalScalerCounter = _intervalScaler;
-AsynchLoop::LoopId Light::_autoOffInterval;
-long Light::_onTimeSeconds;
+AsynchLoop::LoopId Light::_autoOffInterval = INVALID_LOOP;
+uint16_t Light::_onTimeSeconds;
 Light::Status Light::_status;
 
+// Cada fila: el paso de la escena en curso (el ultimo concluye en NONE) y a
+// continuacion la seleccion de cada escena
+#define SELECT_SCENE \
+  {NONE, NULL}, {SEQUENTIAL_ON, NULL}, {SEQUENTIAL_OFF, NULL}, {FADE_ON, NULL}, {FADE_OFF, NULL}, \
+  {SEQUENTIAL_FADE_ON, NULL}, {SEQUENTIAL_FADE_OFF, NULL}
+
+const StateTransition Light::_transitions[SCENES][EVENTS] PROGMEM = {
+  //                          STEP                                             LAST_STEP                            SELECT + escena
+  /* NONE */                {IGNORED,                                        IGNORED,                             SELECT_SCENE},
+  /* SEQUENTIAL_ON */       {{SEQUENTIAL_ON, _sequentialOnStep},             {NONE, _sequentialOnStep},           SELECT_SCENE},
+  /* SEQUENTIAL_OFF */      {{SEQUENTIAL_OFF, _sequentialOffStep},           {NONE, _sequentialOffStep},          SELECT_SCENE},
+  /* FADE_ON */             {{FADE_ON, _fadeOnStep},                         {NONE, _fadeOnStep},                 SELECT_SCENE},
+  /* FADE_OFF */            {{FADE_OFF, _fadeOffStep},                       {NONE, _fadeOffStep},                SELECT_SCENE},
+  /* SEQUENTIAL_FADE_ON */  {{SEQUENTIAL_FADE_ON, _sequentialFadeOnStep},    {NONE, _sequentialFadeOnStep},       SELECT_SCENE},
+  /* SEQUENTIAL_FADE_OFF */ {{SEQUENTIAL_FADE_OFF, _sequentialFadeOffStep},  {NONE, _sequentialFadeOffStep},      SELECT_SCENE},
+};
+
+Light::Machine Light::_machine(NONE);
+
+// Ciclo de escenas: solo mientras hay una en curso (o el apagado automatico
+// por reintentar); on() y off() lo agregan y se quita a si mismo al concluir
+const AsynchLoop::Task Light::_tasks[] PROGMEM = {
+  {_runInterval, NULL, 2, AsynchLoop::LOW_PRIORITY, MAX_SLACK}
+};
+
 // Array que define todas las posibles conbinatorias de secuencias on/off
 // con cada encendido/apagado iran rotando
-Light::ChangeType Light::_changeTypes[] = {
+const Light::ChangeType Light::_changeTypes[] PROGMEM = {
   {_sequentialOn, _sequentialOff},
   {_sequentialFadeOn, _sequentialFadeOff},
   {_fadeOn, _sequentialOff},
@@ -28,36 +51,64 @@ Light::ChangeType Light::_changeTypes[] = {
 uint8_t Light::_activeChangeType = 0;
 
 
-void Light::init(const uint8_t dataPin) {
+void Light::init() {
 
   // Evita algunos milisegundos de destellos indeseados
-  pinMode(dataPin, INPUT_PULLUP);
+  pinMode(Station::LIGHT_DATA_PIN, INPUT_PULLUP);
 
-  _pixels = new Adafruit_NeoPixel(TOTAL_PIXELS, dataPin, NEO_GRB + NEO_KHZ800);
-  _pixels->begin(); // INITIALIZE NeoPixel strip object (REQUIRED)
-  _pixels->clear(); // Set all pixel colors to 'off'
+  _pixels.setPin(Station::LIGHT_DATA_PIN);
+  _pixels.begin(); // INITIALIZE NeoPixel strip object (REQUIRED)
+  _pixels.clear(); // Set all pixel colors to 'off'
   setAll(ZERO_BRIGHT, ZERO_BRIGHT, ZERO_BRIGHT);
-  setInterval(_runInterval, 2);
 
   _onTimeSeconds = ON_TIME_SECONDS;
 
   _status = OFF;
 
+  EventBus::subscribe(EventBus::KEY_RELEASED, _keyReleased);
+
+}
+
+
+/**
+ * On/Off luces: segun el estado y no el led (el apagado automatico no pasa por la tecla)
+ */
+void Light::_keyReleased(uint8_t key) {
+
+  if ( key != Station::LIGHT_KEY )
+    return;
+
+  if ( _status == ON )
+    off();
+  else
+    on();
+
 }
 
 
 void Light::setAll(int red, int green, int blue) {
 
-  for( int i=0; i < TOTAL_PIXELS ; i++ ) {
-    _pixels->setPixelColor(i, _pixels->Color(red, blue, green));
+  for( uint16_t i=0; i < Station::PIXELS ; i++ ) {
+    _pixels.setPixelColor(i, _pixels.Color(red, blue, green));
   }
 
-  _pixels->show();
+  TRACE(LIGHT_FRAME, _machine.state());
+  _pixels.show();
+  TRACE(LIGHT_FRAME_END, _machine.state());
 
 }
 
 
-void Light::_runInterval() {
+void Light::_runInterval(void *) {
+
+  // Sin espacio para el apagado automatico al encender: reintenta
+  if ( _status == ON && _autoOffInterval == INVALID_LOOP )
+    _autoOffInterval = setInterval(_decreaseOnTimeSeconds, 1000);
+
+  if ( ! _step && ! (_status == ON && _autoOffInterval == INVALID_LOOP) ) {
+    AsyncLoop.detach(_tasks);
+    return;
+  }
 
   if ( _intervalScalerCounter ) {
     _intervalScalerCounter--;
@@ -69,107 +120,58 @@ void Light::_runInterval() {
   if ( ! _step )
     return;
 
-  switch (_scene)
-  {
-
-    case SEQUENTIAL_ON: {
-
-      _setZone(_step-1, MAX_BRIGHT, MAX_BRIGHT, MAX_BRIGHT);
-
-      if ( _step == 1 )
-        _scene = NONE;
-
-      break;
-    }
-
-    case SEQUENTIAL_OFF: {
-
-      _setZone(_step-1, ZERO_BRIGHT, ZERO_BRIGHT, ZERO_BRIGHT);
-
-      if ( _step == 1 )
-        _scene = NONE;
+  // El ultimo paso de la escena concluye en NONE
+  _machine.dispatch((_step == 1) ? LAST_STEP : STEP);
 
-      break;
-    }
-
-    case FADE_ON: {
-
-      uint8_t value = (uint8_t) 256 - _step;
-
-      setAll(value, value, value);
-
-      if ( _step == 1 )
-        _scene = NONE;
-
-      break;
-    }
-
-
-    case FADE_OFF: {
+  _step--;
 
-      uint8_t value = (uint8_t) _step - 1;
+}
 
-      setAll(value, value, value);
 
-      if ( _step == 1 )
-        _scene = NONE;
+void Light::_sequentialOnStep() {
+  _setZone(_step-1, MAX_BRIGHT, MAX_BRIGHT, MAX_BRIGHT);
+}
 
-      break;
-    }
 
-    case SEQUENTIAL_FADE_ON: {
+void Light::_sequentialOffStep() {
+  _setZone(_step-1, ZERO_BRIGHT, ZERO_BRIGHT, ZERO_BRIGHT);
+}
 
-      uint8_t value, zone;
 
-      if ( _step > 510 ) {
-        value = (uint8_t) 766 - _step;
-        zone = 0;
-      }
-      else if ( _step > 254 ) {
-        value = (uint8_t) 510 - _step;
-        zone = 1;
-      } else {
-        value = (uint8_t) 255 - _step;
-        zone = 2;
-      }
+void Light::_fadeOnStep() {
+  uint8_t value = (uint8_t) 256 - _step;
+  setAll(value, value, value);
+}
 
-      _setZone(zone, value, value, value);
 
-      if ( _step == 1 )
-        _scene = NONE;
+void Light::_fadeOffStep() {
+  uint8_t value = (uint8_t) _step - 1;
+  setAll(value, value, value);
+}
 
-      break;
-    }
 
-    case SEQUENTIAL_FADE_OFF: {
+/*
+ * 256 pasos por zona, del primer piso al ultimo, con el brillo de cada zona
+ * completo (0 a 255 o 255 a 0). La version para tres pisos fija daba 766
+ * pasos: el umbral entre zonas no coincidia al encender y al apagar, con lo
+ * que la ultima zona encendia hasta 254 y algunas apagaban desde 254
+ */
+void Light::_sequentialFadeOnStep() {
 
-      uint8_t value, zone;
+  uint16_t elapsed = 256 * Station::FLOORS - _step;
+  uint8_t value = elapsed & 0xFF;
 
-      if ( _step > 510 ) {
-        value = (uint8_t) _step - 510 - 1;
-        zone = 0;
-      }
-      else if ( _step > 255 ) {
-        value = (uint8_t) _step - 255 - 1;
-        zone = 1;
-      } else {
-        value = (uint8_t) _step - 1;
-        zone = 2;
-      }
+  _setZone(elapsed >> 8, value, value, value);
 
-      _setZone(zone, value, value, value);
+}
 
-      if ( _step == 1 )
-        _scene = NONE;
 
-      break;
-    }
+void Light::_sequentialFadeOffStep() {
 
-    default:
-      break;
-  }
+  uint16_t elapsed = 256 * Station::FLOORS - _step;
+  uint8_t value = 255 - (elapsed & 0xFF);
 
-  _step--;
+  _setZone(elapsed >> 8, value, value, value);
 
 }
 
@@ -183,15 +185,17 @@ void Light::_setIntervalScaler(uint8_t intervalScaler) {
 void Light::_resetInterval() {
   _intervalScaler = 0;
   _intervalScalerCounter = _intervalScaler;
-  _scene = NONE;
+  _machine.dispatch(SELECT + NONE);
 }
 
 
 void Light::_setZone(uint8_t zone, int red, int green, int blue) {
-  for( int i=_zones[zone].begin; i <= _zones[zone].end ; i++ ) {
-    _pixels->setPixelColor(i, _pixels->Color(red, blue, green));
+  for( uint16_t i=Station::zoneBegin(zone); i <= Station::zoneEnd(zone) ; i++ ) {
+    _pixels.setPixelColor(i, _pixels.Color(red, blue, green));
   }
-  _pixels->show();
+  TRACE(LIGHT_FRAME, _machine.state());
+  _pixels.show();
+  TRACE(LIGHT_FRAME_END, _machine.state());
 }
 
 
@@ -209,43 +213,43 @@ void Light::_off() {
 
 void Light::_sequentialOn() {
   _setIntervalScaler(SCALER_SLOW_SPEED);
-  _scene = SEQUENTIAL_ON;
-  _step = 3;
+  _step = Station::FLOORS;
+  _machine.dispatch(SELECT + SEQUENTIAL_ON);
 }
 
 
 void Light::_sequentialOff() {
   _setIntervalScaler(SCALER_SLOW_SPEED);
-  _scene = SEQUENTIAL_OFF;
-  _step = 3;
+  _step = Station::FLOORS;
+  _machine.dispatch(SELECT + SEQUENTIAL_OFF);
 }
 
 
 void Light::_fadeOn() {
   _setIntervalScaler(SCALER_MEDIUM_SPEED);
-  _scene = FADE_ON;
   _step = 256;
+  _machine.dispatch(SELECT + FADE_ON);
 }
 
 
 void Light::_fadeOff() {
   _setIntervalScaler(SCALER_MEDIUM_SPEED);
-  _scene = FADE_OFF;
   _step = 256;
+  _machine.dispatch(SELECT + FADE_OFF);
 }
 
 
 void Light::_sequentialFadeOn() {
   _setIntervalScaler(SCALER_FAST_SPEED);
-  _scene = SEQUENTIAL_FADE_ON;
-  _step = 766; // 255 * 3 + 1
+  _step = 256 * Station::FLOORS;
+  _machine.dispatch(SELECT + SEQUENTIAL_FADE_ON);
 }
 
 
 void Light::_sequentialFadeOff() {
   _setIntervalScaler(SCALER_FAST_SPEED);
-  _scene = SEQUENTIAL_FADE_OFF;
-  _step = 766; // 255 * 3 + 1
+  _step = 256 * Station::FLOORS;
+  _machine.dispatch(SELECT + SEQUENTIAL_FADE_OFF);
 }
 
 
@@ -255,7 +259,6 @@ void Light::_decreaseOnTimeSeconds() {
 
   if ( ! _onTimeSeconds ) {
     off();
-    clearInterval(_autoOffInterval);
     _onTimeSeconds = ON_TIME_SECONDS;
   }
 
@@ -264,14 +267,20 @@ void Light::_decreaseOnTimeSeconds() {
 
 void Light::on() {
 
-  _changeTypes[_activeChangeType].on();
+  ((void (*)()) pgm_read_ptr(&_changeTypes[_activeChangeType].on))();
   
   // Invoca cada 1 segundo la funcion encargada de controlar el apagado
   // automatico al transcurrir ON_TIME_SECONDS segundos de encendido
+  // (INVALID_LOOP si no queda espacio: _runInterval reintenta)
   _autoOffInterval = setInterval(_decreaseOnTimeSeconds, 1000);
 
   _status = ON;
 
+  if ( _step || _autoOffInterval == INVALID_LOOP )
+    AsyncLoop.attach(_tasks);
+
+  EventBus::post(EventBus::LIGHT_SWITCHED, 1);
+
 }
 
 
@@ -280,7 +289,7 @@ void Light::off() {
   if ( _status == OFF )
     return;
 
-  _changeTypes[_activeChangeType].off();
+  ((void (*)()) pgm_read_ptr(&_changeTypes[_activeChangeType].off))();
 
   _activeChangeType++;
 
@@ -289,7 +298,49 @@ void Light::off() {
 
   // Elimina el intervalo establecido para apagado automatico
   clearInterval(_autoOffInterval);
+  _autoOffInterval = INVALID_LOOP;
 
   _status = OFF;
 
+  if ( _step )
+    AsyncLoop.attach(_tasks);
+
+  EventBus::post(EventBus::LIGHT_SWITCHED, 0);
+
+}
+
+
+uint8_t Light::idle() {
+  return ! _step;
+}
+
+
+Light::Status Light::status() {
+  return _status;
+}
+
+
+uint8_t Light::lit() {
+  return _status == ON;
+}
+
+
+Light::Scene Light::scene() {
+  return (Scene) _machine.state();
+}
+
+
+uint8_t Light::changeType() {
+  return _activeChangeType;
+}
+
+
+uint8_t Light::select(uint8_t changeType) {
+
+  if ( changeType >= arrayLength(_changeTypes) )
+    return 0;
+
+  _activeChangeType = changeType;
+
+  return 1;
 }
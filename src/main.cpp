@@ -13,53 +13,83 @@
 #include "led-indicator.hpp"
 #include "light.hpp"
 #include "elevator.hpp"
+#include "event-bus.hpp"
+#include "power.hpp"
+#include "telemetry.hpp"
+#include "journal.hpp"
 
-// Light (pin de datos WS2811)
-#define LIGHT_DATA_PIN 12
+// Salidas por Serial (perfilado, trace, registro de entradas o telemetria)
+#define SERIAL_ENABLED (ASYNC_LOOP_PROFILE || TRACE_ENABLED || INPUT_RECORD || TELEMETRY_ENABLED)
 
-// Elevator engine
-#define ELEVATOR_ENGINE_PIN_A 9
-#define ELEVATOR_ENGINE_PIN_B 10
-#define ELEVATOR_BUZZER_PIN   13
-
-// Keypad
-#define FLOOR_1  0
-#define FLOOR_2  1
-#define FLOOR_3  2
-#define LIGHT    3
-
-
-                     // segmentos ->  a  b  c  d  e  f   g
-const uint8_t displayPins[]       = { 7, 8, 4, 3, 2, 99, 5 };
-const uint8_t keypadPins[]        = { 17, 16, 14, 15 };
-const uint8_t ledIndicatorPins[]  = { 11 };
-const uint8_t elevatorFloorPins[] = { 18, 19, 6 };
+// Pines, pisos y zonas de luz: ver Station (include/station.hpp)
 
 
 void keypadHandler(uint8_t n);
-void elevatorEnd(uint8_t floor);
+void lightSwitched(uint8_t on);
+uint8_t stationIdle(void);
+#if TELEMETRY_ENABLED
+uint8_t remoteCommand(Telemetry::Type type, uint8_t value);
+#endif
+#if JOURNAL_ENABLED
+void journalSnapshot(Journal::State &state);
+#endif
 
 
 void setup()
 {
-  Light::init(LIGHT_DATA_PIN);
-  Display::init(displayPins, LOW);
-  Keypad::init(keypadPins, arrayLength(keypadPins), keypadHandler);
-  LedIndicator::init(ledIndicatorPins, arrayLength(ledIndicatorPins));
-  Elevator::init(elevatorFloorPins, arrayLength(elevatorFloorPins), ELEVATOR_ENGINE_PIN_A,
-                 ELEVATOR_ENGINE_PIN_B, ELEVATOR_BUZZER_PIN, elevatorEnd);
+#if SERIAL_ENABLED
+  Serial.begin(115200);
+#endif
+
+  Light::init();
+  Display::init();
+  Keypad::init();
+  LedIndicator::init();
+  Elevator::init();
+
+  // Display y Light se suscriben en su init(): el display sigue los
+  // recorridos y las luces atienden su tecla
+  EventBus::subscribe(EventBus::KEY_RELEASED, keypadHandler);
+  EventBus::subscribe(EventBus::LIGHT_SWITCHED, lightSwitched);
+
+  // Las teclas y los finales de carrera despiertan del power-down
+  Power::init(stationIdle);
+  for ( uint8_t key = 0 ; key < Station::KEYS ; key++ )
+    Power::wakeOn(Station::keyPin(key));
+  for ( uint8_t floor = 0 ; floor < Station::FLOORS ; floor++ )
+    Power::wakeOn(Station::floors[floor].limitSwitch);
+
+#if TELEMETRY_ENABLED
+  Telemetry::init(Serial, remoteCommand);
+#endif
 
   uint8_t floor = Elevator::floor();
 
+#if JOURNAL_ENABLED
+  // Restaura la rotacion de escenas y, entre pisos, el recorrido interrumpido
+  uint8_t restored = Journal::init(journalSnapshot);
+  const Journal::State &state = Journal::state();
+
+  if ( restored ) {
+    Light::select(state.changeType);
+    if ( floor == NO_FLOOR )
+      Elevator::restore(state.floor, (Elevator::Direction) state.direction);
+  }
+#endif
+
   /* Si el ascensor se encuentra entre pisos
-   * se lo desplaza hacia el primero
+   * se lo desplaza hacia el primero, o sin la espera
+   * previa hacia el destino del recorrido interrumpido
+   * (el efecto del display lo inicia ELEVATOR_REQUESTED)
    */
   if ( floor != NO_FLOOR )
     Display::show(Elevator::floor() + 1);
-  else {
-    Display::effect(Display::SHIFT_DOWN);
-    Elevator::goTo(FLOOR_1);
-  }
+#if JOURNAL_ENABLED
+  else if ( restored && state.direction != Elevator::NONE && state.floor != NO_FLOOR && state.target != NO_FLOOR )
+    Elevator::goTo(state.target, OFF);
+#endif
+  else
+    Elevator::goTo(0);       // primer piso
   /**/
 
 }
@@ -69,34 +99,137 @@ void loop()
 {
   // Escanea el estado de los switches
   Keypad::scan();
+
+  // Entrega los eventos publicados (teclas, llegada del ascensor)
+  EventBus::dispatch();
+
+  // Ejecuta los ciclos diferidos (display, luces, indicadores)
+  AsyncLoop.dispatch();
+
+#if JOURNAL_ENABLED
+  // Guarda en la EEPROM los cambios de estado (de a un byte)
+  Journal::poll();
+#endif
+
+#if INPUT_RECORD
+  // Envia las entradas registradas (replay/replay.cpp las reproduce en el host)
+  Recorder::flush(Serial);
+#endif
+
+#if TELEMETRY_ENABLED
+  // Consultas de estado y comandos remotos (tools/station-cli.py)
+  Telemetry::poll();
+#elif ASYNC_LOOP_PROFILE || TRACE_ENABLED
+  // Por Serial: 't' solicita el volcado del trace y cualquier otro byte la tabla de perfilado
+  if ( Serial.available() ) {
+    char command = Serial.read();
+#if TRACE_ENABLED
+    if ( command == 't' )
+      Trace::dump(Serial);
+#endif
+#if ASYNC_LOOP_PROFILE
+    if ( command != 't' ) {
+      AsyncLoop.report(Serial);
+      Serial.print(F("duty cycle: "));
+      Serial.print(Power::dutyCycle() / 10.0, 1);
+      Serial.print(F("% power downs: "));
+      Serial.println(Power::powerDowns());
+      Serial.print(F("boot to ready: "));
+      Serial.print(Elevator::bootTime());
+      Serial.println(F(" ms"));
+    }
+#endif
+    (void) command;
+  }
+#endif
+
+  // Duerme hasta la proxima interrupcion (tick, tecla o final de carrera)
+  Power::idle();
 }
 
 
 /**
- * Funcion invocada cuando concluye
- * cualqquier recorrido del ascensror
+ * Determina si la estacion puede detener los timers (power-down):
+ * ascensor estacionado, sin teclas en rebote ni efectos en curso
  */
-void elevatorEnd(uint8_t floor) {
-  Display::clearEffect();
-  Display::show(floor + 1);
+uint8_t stationIdle() {
+#if SERIAL_ENABLED
+  return 0;   // el USART no despierta del power-down
+#else
+  uint8_t idle = Keypad::idle() && Elevator::idle() && Display::idle() && LedIndicator::idle() && Light::idle();
+#if JOURNAL_ENABLED
+  idle = idle && ! Journal::busy();   // sin escrituras de la EEPROM en curso
+#endif
+  return idle;
+#endif
 }
 
 
+#if JOURNAL_ENABLED
 /**
- * Manejo de switches
- * pisos del 1 al 3 y luces
+ * Estado de la estacion que se persiste (los contadores los lleva el Journal)
  */
-void keypadHandler(uint8_t key) {
+void journalSnapshot(Journal::State &state) {
+  state.floor = Elevator::lastFloor();
+  state.direction = Elevator::direction();
+  state.target = (state.direction != Elevator::NONE) ? Elevator::target() : NO_FLOOR;
+  state.changeType = Light::changeType();
+}
+#endif
 
-  // On/Off luces
-  if ( key == LIGHT ) {
 
-    if ( LedIndicator::toggle(0) )
-      Light::on();
-    else
-      Light::off();
+#if TELEMETRY_ENABLED
+/**
+ * Comandos recibidos por Telemetry: tienen el mismo efecto que las teclas
+ */
+uint8_t remoteCommand(Telemetry::Type type, uint8_t value) {
+
+  switch ( type ) {
+
+    case Telemetry::GO_TO:
+      if ( value >= Station::FLOORS || Elevator::status() != Elevator::READY )
+        return 0;
+      keypadHandler(value);
+      return 1;
+
+    case Telemetry::SET_LIGHT:
+      // El led sigue a LIGHT_SWITCHED
+      if ( (value != 0) != Light::lit() ) {
+        if ( value )
+          Light::on();
+        else
+          Light::off();
+      }
+      return 1;
+
+    case Telemetry::SET_SCENE:
+      return Light::select(value);
+
+    default:
+      return 0;
   }
-  //
+
+}
+#endif
+
+
+/**
+ * El led de la tecla de luces refleja el estado de las luces
+ * (incluso tras el apagado automatico)
+ */
+void lightSwitched(uint8_t on) {
+  if ( on )
+    LedIndicator::on(0);
+  else
+    LedIndicator::off(0);
+}
+
+
+/**
+ * Manejo de switches de pisos (Station::FLOORS); la tecla
+ * de luces la atiende Light
+ */
+void keypadHandler(uint8_t key) {
 
   // Obtiene piso actual donde esta el ascensor
   uint8_t floor = Elevator::floor();
@@ -105,15 +238,7 @@ void keypadHandler(uint8_t key) {
    * los pisos distintos del actual y el
    * ascensor se encuentra listo
    */
-  if ( key != LIGHT && Elevator::status() == Elevator::READY && key != floor ) {
-
-    // Ascensor entre pisos
-    if ( floor == NO_FLOOR )
-      Display::effect(Display::RIGHT_ROTATION);
-    else if ( key < floor ) // solicitud de bajada
-      Display::effect(Display::SHIFT_DOWN);
-    else // solicitud de subida
-      Display::effect(Display::SHIFT_UP);
+  if ( key != Station::LIGHT_KEY && Elevator::status() == Elevator::READY && key != floor ) {
 
     // Ir al piso key
     Elevator::goTo(key);
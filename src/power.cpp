@@ -0,0 +1,104 @@
+/*
+ * power.cpp
+ * Copyright 2020 - Juan C. Bryksa (jcbryksa@gmail.com)
+ */
+
+#include "power.hpp"
+
+uint8_t (*Power::_canPowerDown)(void) = NULL;
+uint8_t Power::_pcicr = 0;
+unsigned long Power::_windowStart = 0;
+unsigned long Power::_sleepMicros = 0;
+unsigned long Power::_powerDowns = 0;
+
+// Solo despiertan al CPU: el cambio lo detectan los escaneos
+EMPTY_INTERRUPT(PCINT0_vect);
+EMPTY_INTERRUPT(PCINT1_vect);
+EMPTY_INTERRUPT(PCINT2_vect);
+
+
+void Power::init(uint8_t (*canPowerDown)(void)) {
+  _canPowerDown = canPowerDown;
+  _windowStart = micros();
+}
+
+
+void Power::wakeOn(uint8_t pin) {
+
+  if ( ! digitalPinToPCICR(pin) )
+    return;
+
+  // Habilita el pin en su mascara; el grupo se habilita solo durante el power-down
+  *digitalPinToPCMSK(pin) |= _BV(digitalPinToPCMSKbit(pin));
+  _pcicr |= _BV(digitalPinToPCICRbit(pin));
+
+}
+
+
+void Power::idle() {
+
+  // Con las interrupciones deshabilitadas ningun vencimiento o evento
+  // puede quedar sin atender entre la verificacion y el sleep
+  cli();
+
+  if ( AsyncLoop.pending() || EventBus::pending() ) {
+    sei();
+    return;
+  }
+
+  uint8_t powerDown = AsyncLoop.nextDeadline() < 0 && _canPowerDown && _canPowerDown();
+
+  if ( powerDown ) {
+
+    _powerDowns++;
+    PCIFR = _pcicr;
+    PCICR |= _pcicr;
+
+    set_sleep_mode(SLEEP_MODE_PWR_DOWN);
+    sleep_enable();
+#if defined(sleep_bod_disable)
+    sleep_bod_disable();
+#endif
+    sei();                      // la instruccion siguiente a sei() se ejecuta antes de cualquier interrupcion
+    sleep_cpu();
+    sleep_disable();
+
+    PCICR &= ~_pcicr;
+  }
+  else {
+
+    unsigned long start = micros();
+
+    set_sleep_mode(SLEEP_MODE_IDLE);
+    sleep_enable();
+    sei();
+    sleep_cpu();
+    sleep_disable();
+
+    _sleepMicros += micros() - start;
+  }
+
+}
+
+
+uint16_t Power::dutyCycle() {
+
+  unsigned long now = micros();
+  unsigned long total = (now - _windowStart) / 1000;  // ms
+  unsigned long sleep = _sleepMicros / 1000;
+
+  if ( sleep > total )
+    sleep = total;
+
+  uint16_t duty = (total) ? 1000 - sleep * 1000 / total : 1000;
+
+  _windowStart = now;
+  _sleepMicros = 0;
+
+  return duty;
+}
+
+
+unsigned long Power::powerDowns() {
+  return _powerDowns;
+}
@@ -0,0 +1,89 @@
+/*
+ * recorder.cpp
+ * Copyright 2020 - Juan C. Bryksa (jcbryksa@gmail.com)
+ */
+
+#include "recorder.hpp"
+#include "async-loop.hpp"
+
+#if INPUT_RECORD
+
+#define RECORD_LINE_LENGTH 20        // "I 4294967295 255 1\r\n"
+
+Recorder::Record Recorder::_records[RECORD_BUFFER_SIZE];
+volatile uint8_t Recorder::_head = 0;
+uint8_t Recorder::_tail = 0;
+uint16_t Recorder::_lost = 0;
+uint32_t Recorder::_known = 0;
+uint32_t Recorder::_levels = 0;
+
+
+int Recorder::edge(uint8_t pin, int level) {
+
+  uint32_t mask = 1UL << (pin & 31);
+  uint8_t high = (level != LOW);
+
+  if ( (_known & mask) && ((_levels & mask) != 0) == high )
+    return level;
+
+  // Se lee desde loop() (teclas) y desde el ISR (finales de carrera)
+  char sreg = SREG;
+  cli();
+
+  // Sin lugar se descarta y se vuelve a intentar en la proxima lectura
+  if ( (uint8_t) (_head - _tail) == RECORD_BUFFER_SIZE ) {
+    if ( _lost < 0xFFFF )
+      _lost++;
+    SREG = sreg;
+    return level;
+  }
+
+  Record &record = _records[_head & (RECORD_BUFFER_SIZE - 1)];
+  record.tick = AsyncLoop.ticks();
+  record.pin = pin;
+  record.level = high;
+  _head++;
+
+  _known |= mask;
+  if ( high )
+    _levels |= mask;
+  else
+    _levels &= ~mask;
+
+  SREG = sreg;
+
+  return level;
+}
+
+
+void Recorder::flush(Print &out) {
+
+  char sreg;
+
+  if ( _lost && out.availableForWrite() >= RECORD_LINE_LENGTH ) {
+    sreg = SREG;
+    cli();
+    uint16_t lost = _lost;
+    _lost = 0;
+    SREG = sreg;
+    out.print(F("lost "));
+    out.println(lost);
+  }
+
+  // El registro en _tail no se sobrescribe hasta avanzar _tail
+  while ( _tail != _head && out.availableForWrite() >= RECORD_LINE_LENGTH ) {
+    Record &record = _records[_tail & (RECORD_BUFFER_SIZE - 1)];
+    out.print(F("I "));
+    out.print(record.tick);
+    out.print(' ');
+    out.print(record.pin);
+    out.print(' ');
+    out.println(record.level);
+    sreg = SREG;
+    cli();
+    _tail++;
+    SREG = sreg;
+  }
+}
+
+#endif
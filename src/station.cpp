@@ -0,0 +1,11 @@
+/*
+ * station.cpp
+ * Copyright 2020 - Juan C. Bryksa (jcbryksa@gmail.com)
+ */
+
+#include "station.hpp"
+
+// Definiciones de las tablas (se indexan en tiempo de ejecucion)
+constexpr Station::Floor Station::floors[];
+constexpr uint8_t Station::displayPins[];
+constexpr uint8_t Station::ledPins[];
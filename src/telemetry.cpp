@@ -0,0 +1,179 @@
+/*
+ * telemetry.cpp
+ * Copyright 2020 - Juan C. Bryksa (jcbryksa@gmail.com)
+ */
+
+#include "telemetry.hpp"
+
+#if TELEMETRY_ENABLED
+
+#include "light.hpp"
+#include "elevator.hpp"
+#include "event-bus.hpp"
+
+Stream *Telemetry::_port = NULL;
+uint8_t (*Telemetry::_command)(Telemetry::Type, uint8_t) = NULL;
+Telemetry::State Telemetry::_state = WAIT_SYNC;
+uint8_t Telemetry::_length;
+uint8_t Telemetry::_type;
+uint8_t Telemetry::_received;
+uint8_t Telemetry::_crc;
+uint8_t Telemetry::_payload[TELEMETRY_MAX_PAYLOAD];
+unsigned long Telemetry::_timestamp = 0;
+uint8_t Telemetry::_errors = 0;
+uint8_t Telemetry::_dropped = 0;
+
+
+void Telemetry::init(Stream &port, uint8_t (*command)(Telemetry::Type, uint8_t)) {
+  _port = &port;
+  _command = command;
+}
+
+
+void Telemetry::poll() {
+
+  if ( ! _port )
+    return;
+
+  // Una trama incompleta (byte perdido) se descarta al vencer el timeout
+  if ( _state != WAIT_SYNC && millis() - _timestamp > TELEMETRY_TIMEOUT ) {
+    _state = WAIT_SYNC;
+    if ( _errors < 255 )
+      _errors++;
+  }
+
+  while ( _port->available() ) {
+    _timestamp = millis();
+    _receive(_port->read());
+  }
+
+}
+
+
+void Telemetry::_receive(uint8_t byte) {
+
+  switch ( _state ) {
+
+    case WAIT_SYNC:
+      if ( byte == TELEMETRY_SYNC )
+        _state = WAIT_LENGTH;
+      break;
+
+    case WAIT_LENGTH:
+      if ( byte > TELEMETRY_MAX_PAYLOAD ) {
+        _state = (byte == TELEMETRY_SYNC) ? WAIT_LENGTH : WAIT_SYNC;
+        if ( _errors < 255 )
+          _errors++;
+        break;
+      }
+      _length = byte;
+      _crc = _crc8_ccitt_update(0, byte);
+      _state = WAIT_TYPE;
+      break;
+
+    case WAIT_TYPE:
+      _type = byte;
+      _crc = _crc8_ccitt_update(_crc, byte);
+      _received = 0;
+      _state = _length ? WAIT_DATA : WAIT_CRC;
+      break;
+
+    case WAIT_DATA:
+      _payload[_received++] = byte;
+      _crc = _crc8_ccitt_update(_crc, byte);
+      if ( _received == _length )
+        _state = WAIT_CRC;
+      break;
+
+    case WAIT_CRC:
+      _state = WAIT_SYNC;
+      if ( byte == _crc )
+        _execute();
+      else if ( _errors < 255 )
+        _errors++;
+      break;
+  }
+
+}
+
+
+void Telemetry::_execute() {
+
+  uint8_t reply[2] = {_type, 0};
+
+  switch ( _type ) {
+
+    case STATUS_REQUEST:
+      _sendStatus();
+      return;
+
+    case GO_TO:
+    case SET_LIGHT:
+    case SET_SCENE:
+      if ( _length != 1 )
+        reply[1] = BAD_LENGTH;
+      else if ( ! _command || ! _command((Type) _type, _payload[0]) )
+        reply[1] = REJECTED;
+      break;
+
+    default:
+      reply[1] = UNKNOWN_TYPE;
+  }
+
+  if ( reply[1] )
+    _send(NACK, reply, 2);
+  else
+    _send(ACK, reply, 1);
+
+}
+
+
+void Telemetry::_sendStatus() {
+
+  unsigned long bootTime = Elevator::bootTime();
+  if ( bootTime > 0xFFFF )
+    bootTime = 0xFFFF;
+
+  uint8_t status[] = {
+    (uint8_t) Elevator::status(),
+    Elevator::floor(),
+    (uint8_t) Light::status(),
+    (uint8_t) Light::scene(),
+    Light::changeType(),
+    AsyncLoop.active(),
+    MAX_ASYNC_LOOPS,
+    EventBus::dropped(),
+    _errors,
+    _dropped,
+    (uint8_t) bootTime,
+    (uint8_t) (bootTime >> 8)
+  };
+
+  _send(STATUS, status, sizeof(status));
+}
+
+
+void Telemetry::_send(uint8_t type, const uint8_t *payload, uint8_t length) {
+
+  // SYNC, largo, tipo, datos y CRC: se encola completa o no se encola
+  if ( _port->availableForWrite() < length + 4 ) {
+    if ( _dropped < 255 )
+      _dropped++;
+    return;
+  }
+
+  uint8_t crc = _crc8_ccitt_update(_crc8_ccitt_update(0, length), type);
+
+  _port->write(TELEMETRY_SYNC);
+  _port->write(length);
+  _port->write(type);
+
+  for ( uint8_t i = 0 ; i < length ; i++ ) {
+    _port->write(payload[i]);
+    crc = _crc8_ccitt_update(crc, payload[i]);
+  }
+
+  _port->write(crc);
+}
+
+#endif
@@ -0,0 +1,73 @@
+/*
+ * trace.cpp
+ * Copyright 2020 - Juan C. Bryksa (jcbryksa@gmail.com)
+ */
+
+#include "trace.hpp"
+
+#if TRACE_ENABLED
+
+Trace::Record Trace::_records[TRACE_BUFFER_SIZE];
+uint8_t Trace::_head = 0;
+uint8_t Trace::_count = 0;
+uint8_t Trace::_paused = 0;
+uint16_t Trace::_lost = 0;
+
+
+void Trace::record(Trace::Event event, uint8_t arg) {
+
+  char sreg = SREG;
+  cli();
+
+  if ( _paused || _count == TRACE_BUFFER_SIZE ) {
+    if ( _lost < 0xFFFF )
+      _lost++;
+  }
+
+  if ( ! _paused ) {
+    Record &record = _records[_head & (TRACE_BUFFER_SIZE - 1)];
+    record.time = micros();
+    record.event = event;
+    record.arg = arg;
+    _head++;
+    if ( _count < TRACE_BUFFER_SIZE )
+      _count++;
+  }
+
+  SREG = sreg;
+}
+
+
+void Trace::dump(Print &out) {
+
+  // Los eventos que ocurren durante el volcado se descartan (y se cuentan)
+  char sreg = SREG;
+  cli();
+  _paused = 1;
+  SREG = sreg;
+
+  out.print(F("trace "));
+  out.print(_count);
+  out.print(' ');
+  out.println(_lost);
+
+  for ( uint8_t i = _head - _count ; i != _head ; i++ ) {
+    Record &record = _records[i & (TRACE_BUFFER_SIZE - 1)];
+    out.print(record.time);
+    out.print(' ');
+    out.print(record.event);
+    out.print(' ');
+    out.println(record.arg);
+  }
+
+  out.println(F("end"));
+
+  sreg = SREG;
+  cli();
+  _count = 0;
+  _lost = 0;
+  _paused = 0;
+  SREG = sreg;
+}
+
+#endif
@@ -0,0 +1,567 @@
+/*
+ * async-loop-test.cpp
+ * Copyright 2020 - Juan C. Bryksa (jcbryksa@gmail.com)
+ *
+ * Pruebas de AsynchLoop en el host (pio test -e test, test-timer0,
+ * test-timer1, test-absolute o test-tickless): cada entorno compila el backend de timer
+ * correspondiente, cuyo vector se invoca con el tiempo real simulado.
+ * La deriva acumulada de ticks() respecto de ese tiempo debe quedar
+ * acotada a un tick, por largo que sea el recorrido
+ */
+
+#include <Arduino.h>
+#include <unity.h>
+#include "async-loop.hpp"
+
+#if ASYNC_LOOP_TIMER == 2
+#define TICK_VECTOR TIMER2_COMPA_vect
+#elif ASYNC_LOOP_TIMER == 0
+#define TICK_VECTOR TIMER0_COMPB_vect
+#elif ASYNC_LOOP_ABSOLUTE
+#define TICK_VECTOR TIMER1_COMPA_vect
+#else
+#define TICK_VECTOR TIMER1_OVF_vect
+#endif
+
+extern "C" void TICK_VECTOR(void);
+
+#define DRIFT_TICKS  3600000UL     // una hora de ticks de 1 ms
+#define SECOND       1000
+
+static unsigned long seconds = 0;  // ejecuciones del intervalo de 1 s
+static unsigned long fires = 0;    // ejecuciones de los loops de la cola de comandos
+static unsigned long realMicros = 0;
+static unsigned long counters[MAX_ASYNC_LOOPS]; // ejecuciones de cada loop con contexto
+static AsynchLoop::LoopId lastAttach = 0;        // resultado de un attach desde el ISR
+
+
+static void countSecond(void) {
+  seconds++;
+}
+
+
+static void countFire(void) {
+  fires++;
+}
+
+
+static void countContext(void *counter) {
+  (*(unsigned long *) counter)++;
+}
+
+
+static void attachFromIsr(void) {
+  lastAttach = setTimeout(countFire, 1);
+}
+
+
+static unsigned long lowFires = 0;
+static unsigned long lowAtHigh = 0;      // ejecuciones del LOW al ejecutarse el HIGH_PRIORITY
+static unsigned long lowAtCritical = 0;  // idem al ejecutarse el CRITICAL
+static uint8_t highFires = 0;
+static uint8_t criticalFires = 0;
+
+
+static void countLow(void) {
+  lowFires++;
+}
+
+
+static void countHigh(void) {
+  highFires++;
+  lowAtHigh = lowFires;
+}
+
+
+static void countCritical(void) {
+  criticalFires++;
+  lowAtCritical = lowFires;
+}
+
+
+static unsigned long taskFires = 0;
+static unsigned long scanFires = 0;
+static uint8_t scanBudget = 0;     // ejecuciones restantes del escaneo antes de quitarse
+
+static void countTask(void *) {
+  taskFires++;
+}
+
+static void scanTask(void *);
+
+static const AsynchLoop::Task tasks[] PROGMEM = {
+  {countTask, NULL, 1, AsynchLoop::LOW_PRIORITY, 0}
+};
+
+static const AsynchLoop::Task scanTasks[] PROGMEM = {
+  {scanTask, NULL, 1, AsynchLoop::CRITICAL, 0}
+};
+
+// Como Elevator::_scan: se quita a si mismo al quedar en reposo
+static void scanTask(void *) {
+  scanFires++;
+  if ( ! --scanBudget )
+    AsyncLoop.detach(scanTasks);
+}
+
+
+// Ejecuciones de un loop agregado con tolerancia
+typedef struct {
+  unsigned long fires;
+  unsigned long first;             // tick de la primera ejecucion
+} Coalesced;
+
+static Coalesced coalesced[3];
+static unsigned long wakeups = 0;  // ticks distintos en que se ejecuto alguno de ellos
+static unsigned long lastWakeup = 0;
+
+static void countCoalesced(void *context) {
+  Coalesced *loop = (Coalesced *) context;
+  unsigned long now = AsyncLoop.ticks();
+  if ( ! loop->fires++ )
+    loop->first = now;
+  if ( now != lastWakeup ) {
+    wakeups++;
+    lastWakeup = now;
+  }
+}
+
+
+void setUp(void) {
+}
+
+
+void tearDown(void) {
+}
+
+
+#if ASYNC_LOOP_ABSOLUTE
+static uint32_t seed = 1;
+
+// xorshift32: la misma secuencia en cualquier plataforma
+static uint32_t randomBelow(uint32_t n) {
+  seed ^= seed << 13;
+  seed ^= seed >> 17;
+  seed ^= seed << 5;
+  return seed % n;
+}
+
+
+/*
+ * Cuenta libre del Timer1 (4 us por cuenta): el vector se atiende al alcanzar
+ * OCR1A o, con las interrupciones bloqueadas, hasta 200 ms despues
+ */
+static void interrupt(uint8_t blocked) {
+
+  uint16_t wait = OCR1A - TCNT1;
+  unsigned long counts = wait ? wait : 65536UL;
+
+  if ( blocked && randomBelow(100) < 5 )
+    counts += randomBelow(200 * TICK_COUNTS);
+
+  realMicros += counts * 4;
+  TCNT1 += counts;
+  TICK_VECTOR();
+}
+#else
+/*
+ * Periodo fijo de cada backend: 1 ms (Timer2 y Timer1) o 1.024 ms (Timer0)
+ */
+static void interrupt(uint8_t) {
+#if ASYNC_LOOP_TIMER == 0
+  realMicros += TIMER0_TICK_MICROS;
+#else
+  realMicros += 1000;
+#endif
+  TICK_VECTOR();
+}
+#endif
+
+
+/*
+ * Un tick (a veces atrasado, en el modo absoluto) y a continuacion loop()
+ */
+static void tick(void) {
+  interrupt(1);
+  AsyncLoop.dispatch();
+}
+
+
+void test_tick_period(void) {
+
+  setInterval(countSecond, SECOND);
+  TEST_ASSERT_EQUAL(1, AsyncLoop.active());
+
+#if ASYNC_LOOP_TIMER == 1 && ! ASYNC_LOOP_ABSOLUTE
+  // Modo 8 (sube y baja hasta ICR1) sin prescaler: 2 * ICR1 ciclos por overflow
+  TEST_ASSERT_EQUAL(1000, 2UL * ICR1 * 1000000UL / F_CPU);
+#elif ASYNC_LOOP_TIMER == 2
+  TEST_ASSERT_EQUAL(1000, (OCR2A + 1UL) * 64 * 1000000UL / F_CPU);
+#endif
+
+}
+
+
+void test_cumulative_drift(void) {
+
+  long worst = 0;
+
+  while ( realMicros < DRIFT_TICKS * 1000 ) {
+
+    tick();
+
+    // Diferencia entre los ticks descontados y el tiempo real transcurrido
+    long drift = (long) AsyncLoop.ticks() - (long) (realMicros / 1000);
+    if ( drift < 0 )
+      drift = -drift;
+    if ( drift > worst )
+      worst = drift;
+  }
+
+  TEST_ASSERT_LESS_OR_EQUAL(1, worst);
+
+  // El intervalo conserva la fase: una ejecucion por segundo real
+  TEST_ASSERT_INT_WITHIN(1, realMicros / 1000000UL, seconds);
+
+}
+
+
+/*
+ * Con la cola de altas y bajas llena (ningun tick la vacia, como con las
+ * interrupciones deshabilitadas) attach() falla y detach() se aplica en el acto
+ */
+void test_command_queue_full(void) {
+
+  AsynchLoop::LoopId id = setInterval(countFire, 1);
+  TEST_ASSERT_NOT_EQUAL(INVALID_LOOP, id);
+  tick();
+  tick();
+  TEST_ASSERT_GREATER_OR_EQUAL(1, fires);
+
+  // Bajas de un id ya invalido (otra generacion del mismo espacio)
+  for ( uint8_t i = 0 ; i < COMMAND_QUEUE_SIZE ; i++ )
+    AsyncLoop.detach(id ^ 0x0100);
+
+  TEST_ASSERT_EQUAL(INVALID_LOOP, setTimeout(countFire, 1));
+
+  AsyncLoop.detach(id);
+  unsigned long before = fires;
+  tick();
+  tick();
+  TEST_ASSERT_EQUAL(before, fires);
+
+  // El tick vacio la cola
+  TEST_ASSERT_NOT_EQUAL(INVALID_LOOP, setTimeout(countFire, 1));
+
+}
+
+
+/*
+ * Agrega loops desde loop() hasta completar MAX_ASYNC_LOOPS activos (cada
+ * tick repone los SPARE_LOOPS espacios) o hasta ocupar el espacio indicado
+ * Retorna la cantidad agregada en ids
+ */
+static uint8_t fill(AsynchLoop::LoopId *ids, uint8_t slot = NO_LOOP) {
+
+  uint8_t count = 0;
+
+  while ( AsyncLoop.active() < MAX_ASYNC_LOOPS ) {
+
+    AsynchLoop::LoopId id = AsyncLoop.attach(countContext, &counters[count], 1);
+    if ( id == INVALID_LOOP ) {
+      tick();
+      continue;
+    }
+
+    ids[count++] = id;
+    if ( (id & 0xFF) == slot )
+      break;
+  }
+
+  return count;
+}
+
+
+static void release(AsynchLoop::LoopId *ids, uint8_t count) {
+  for ( uint8_t i = 0 ; i < count ; i++ )
+    AsyncLoop.detach(ids[i]);
+  tick();
+}
+
+
+/*
+ * La baja de un id vencido no afecta al loop que reutiliza su espacio
+ */
+void test_stale_detach(void) {
+
+  AsynchLoop::LoopId stale = setTimeout(countFire, 1);
+  TEST_ASSERT_NOT_EQUAL(INVALID_LOOP, stale);
+  tick();
+  tick();                    // vence y libera el espacio
+
+  AsynchLoop::LoopId ids[MAX_ASYNC_LOOPS];
+  uint8_t count = fill(ids, stale & 0xFF);
+  AsynchLoop::LoopId reused = ids[count - 1];
+
+  TEST_ASSERT_EQUAL(stale & 0xFF, reused & 0xFF);
+  TEST_ASSERT_NOT_EQUAL(stale, reused);
+  tick();
+
+  AsyncLoop.detach(stale);
+  unsigned long before = counters[count - 1];
+  tick();
+  tick();
+  TEST_ASSERT_GREATER_THAN(before, counters[count - 1]);
+
+  release(ids, count);
+
+}
+
+
+/*
+ * Con los MAX_ASYNC_LOOPS espacios ocupados attach() retorna INVALID_LOOP,
+ * tanto desde loop() como desde el ISR
+ */
+void test_attach_full(void) {
+
+  AsynchLoop::LoopId ids[MAX_ASYNC_LOOPS];
+  uint8_t count = fill(ids);
+
+  TEST_ASSERT_EQUAL(MAX_ASYNC_LOOPS, AsyncLoop.active());
+  TEST_ASSERT_EQUAL(INVALID_LOOP, setTimeout(countFire, 1));
+  tick();
+  TEST_ASSERT_EQUAL(INVALID_LOOP, setTimeout(countFire, 1));
+
+  // El ultimo espacio lo ocupa un CRITICAL que intenta otro alta desde el ISR
+  release(ids + count - 1, 1);
+  TEST_ASSERT_NOT_EQUAL(INVALID_LOOP, AsyncLoop.attach(attachFromIsr, 1, AsynchLoop::ONE_TIME, AsynchLoop::CRITICAL));
+  tick();
+  tick();
+  TEST_ASSERT_EQUAL(INVALID_LOOP, lastAttach);
+
+  release(ids, count - 1);
+
+}
+
+
+/*
+ * Un LOW_PRIORITY pendiente no demora a los de mayor prioridad que vencen
+ * despues: estos se ejecutan en el tick, el LOW solo desde dispatch()
+ */
+void test_priorities(void) {
+
+  AsynchLoop::LoopId low = setInterval(countLow, 1);
+  TEST_ASSERT_NOT_EQUAL(INVALID_LOOP, AsyncLoop.attach(countHigh, 2, AsynchLoop::ONE_TIME, AsynchLoop::HIGH_PRIORITY));
+  TEST_ASSERT_NOT_EQUAL(INVALID_LOOP, AsyncLoop.attach(countCritical, 2, AsynchLoop::ONE_TIME, AsynchLoop::CRITICAL));
+
+  // Primer tick: vence el LOW (los otros un tick despues) y queda pendiente
+  interrupt(0);
+  TEST_ASSERT_TRUE(AsyncLoop.pending());
+  TEST_ASSERT_EQUAL(0, lowFires);
+
+  // Solo ticks, sin loop(): el LOW sigue pendiente
+  for ( uint8_t i = 0 ; i < 3 && ! (highFires && criticalFires) ; i++ )
+    interrupt(0);
+
+  TEST_ASSERT_EQUAL(1, highFires);
+  TEST_ASSERT_EQUAL(1, criticalFires);
+  TEST_ASSERT_EQUAL(0, lowAtHigh);
+  TEST_ASSERT_EQUAL(0, lowAtCritical);
+  TEST_ASSERT_EQUAL(0, lowFires);
+
+  AsyncLoop.dispatch();
+  TEST_ASSERT_GREATER_OR_EQUAL(1, lowFires);
+  TEST_ASSERT_FALSE(AsyncLoop.pending());
+
+  AsyncLoop.detach(low);
+  tick();
+
+}
+
+
+/*
+ * Tareas fijas agregadas y quitadas a demanda: detach descarta lo pendiente,
+ * attach no las duplica y un CRITICAL puede quitarse desde su handler
+ */
+void test_task_detach(void) {
+
+  TEST_ASSERT_EQUAL(1, AsyncLoop.attach(tasks));
+  TEST_ASSERT_EQUAL(1, AsyncLoop.attach(tasks));    // ya agregada
+  tick();
+  tick();
+  TEST_ASSERT_GREATER_OR_EQUAL(1, taskFires);
+
+  // Solo ticks: queda pendiente y detach la descarta
+  interrupt(0);
+  TEST_ASSERT_TRUE(AsyncLoop.pending());
+  AsyncLoop.detach(tasks);
+  TEST_ASSERT_FALSE(AsyncLoop.pending());
+
+  unsigned long before = taskFires;
+  for ( uint8_t i = 0 ; i < 10 ; i++ )
+    tick();
+  TEST_ASSERT_EQUAL(before, taskFires);
+
+  // Vuelve a su espacio: una ejecucion por tick
+  AsyncLoop.attach(tasks);
+  AsyncLoop.attach(tasks);
+  before = taskFires;
+  for ( uint8_t i = 0 ; i < 10 ; i++ )
+    interrupt(0);
+  AsyncLoop.dispatch();
+  TEST_ASSERT_INT_WITHIN(1, before + 10, taskFires);
+  AsyncLoop.detach(tasks);
+
+  scanBudget = 3;
+  AsyncLoop.attach(scanTasks);
+  for ( uint8_t i = 0 ; i < 10 ; i++ )
+    tick();
+  TEST_ASSERT_EQUAL(3, scanFires);
+
+  scanBudget = 2;
+  AsyncLoop.attach(scanTasks);
+  for ( uint8_t i = 0 ; i < 10 ; i++ )
+    tick();
+  TEST_ASSERT_EQUAL(5, scanFires);
+
+}
+
+
+/*
+ * Loops de periodos multiplos entre si agregados con MAX_SLACK en distintos
+ * momentos: el primer vencimiento se demora menos de un periodo hasta un
+ * multiplo de este, y desde entonces todos vencen en los ticks del de 100 ms
+ */
+void test_slack_coalescing(void) {
+
+  const long periods[] = {100, 200, 800};
+  AsynchLoop::LoopId ids[3];
+  unsigned long attached[3];
+
+  wakeups = 0;
+  lastWakeup = AsyncLoop.ticks();
+
+  for ( uint8_t i = 0 ; i < 3 ; i++ ) {
+    coalesced[i].fires = 0;
+    ids[i] = AsyncLoop.attach(countCoalesced, &coalesced[i], periods[i], AsynchLoop::CYCLIC,
+                              AsynchLoop::LOW_PRIORITY, MAX_SLACK);
+    TEST_ASSERT_NOT_EQUAL(INVALID_LOOP, ids[i]);
+    attached[i] = AsyncLoop.ticks();
+
+    // Desde loop() el alta se aplica en el tick siguiente
+    for ( uint8_t n = 0 ; n < 37 ; n++ ) {
+      interrupt(0);
+      AsyncLoop.dispatch();
+    }
+  }
+
+  while ( AsyncLoop.ticks() < attached[2] + 1700 ) {
+    interrupt(0);
+    AsyncLoop.dispatch();
+  }
+
+  for ( uint8_t i = 0 ; i < 3 ; i++ ) {
+    AsyncLoop.detach(ids[i]);
+    TEST_ASSERT_EQUAL(0, coalesced[i].first % periods[i]);
+    TEST_ASSERT_GREATER_OR_EQUAL(attached[i] + periods[i], coalesced[i].first);
+    TEST_ASSERT_LESS_THAN(attached[i] + 2 * periods[i], coalesced[i].first);
+  }
+
+  // Los de 200 y 800 ms no agregan ticks propios
+  TEST_ASSERT_GREATER_THAN(0, coalesced[2].fires);
+  TEST_ASSERT_EQUAL(coalesced[0].fires, wakeups);
+
+}
+
+
+#if ASYNC_LOOP_TICKLESS
+static unsigned long firedMicros = 0;
+
+static void markFired(void) {
+  firedMicros = realMicros;
+}
+
+static void markTask(void *) {
+  markFired();
+}
+
+static const AsynchLoop::Task slowTasks[] PROGMEM = {
+  {markTask, NULL, 10, AsynchLoop::CRITICAL, 0}
+};
+
+
+/*
+ * Sin vencimientos cercanos el tick se programa hasta TICKLESS_MAX_PERIOD
+ * ms, sin deriva; un alta desde loop() adelanta la comparacion y vence a tiempo
+ */
+void test_tickless(void) {
+
+  // Solo queda el intervalo de 1 s de test_tick_period
+  unsigned long begin = realMicros;
+  unsigned long beginTicks = AsyncLoop.ticks();
+  unsigned long interrupts = 0;
+  unsigned long secondsBefore = seconds;
+  unsigned long missed = AsyncLoop.missedTicks();
+
+  while ( realMicros - begin < 10UL * SECOND * 1000 ) {
+    interrupt(0);
+    AsyncLoop.dispatch();
+    interrupts++;
+  }
+
+  TEST_ASSERT_LESS_OR_EQUAL(10UL * SECOND / TICKLESS_MAX_PERIOD + 10, interrupts);
+  TEST_ASSERT_INT_WITHIN(1, (realMicros - begin) / 1000, AsyncLoop.ticks() - beginTicks);
+  TEST_ASSERT_INT_WITHIN(1, 10, seconds - secondsBefore);
+  TEST_ASSERT_EQUAL(missed, AsyncLoop.missedTicks());   // omitidos, no perdidos
+
+  // loop() a mitad del periodo programado
+  TEST_ASSERT_GREATER_THAN(10UL * TICK_COUNTS, (uint16_t) (OCR1A - TCNT1));
+  uint16_t midway = (uint16_t) (OCR1A - TCNT1) / 2;
+  TCNT1 += midway;
+  realMicros += midway * 4UL;
+
+  unsigned long requested = realMicros;
+  TEST_ASSERT_NOT_EQUAL(INVALID_LOOP, setTimeout(markFired, 5));
+  while ( ! firedMicros ) {
+    interrupt(0);
+    AsyncLoop.dispatch();
+  }
+
+  // Como con tick fijo: se aplica en el tick siguiente y vence 4 a 5 ms despues
+  TEST_ASSERT_INT_WITHIN(500, 4500, firedMicros - requested);
+
+  // Una tarea fija agregada desde loop() descuenta lo ya transcurrido del periodo
+  midway = (uint16_t) (OCR1A - TCNT1) / 2;
+  TCNT1 += midway;
+  realMicros += midway * 4UL;
+
+  firedMicros = 0;
+  requested = realMicros;
+  AsyncLoop.attach(slowTasks);
+  while ( ! firedMicros )
+    interrupt(0);
+  AsyncLoop.detach(slowTasks);
+
+  TEST_ASSERT_INT_WITHIN(500, 9500, firedMicros - requested);
+
+}
+#endif
+
+
+int main(void) {
+
+  UNITY_BEGIN();
+  RUN_TEST(test_tick_period);
+  RUN_TEST(test_cumulative_drift);
+  RUN_TEST(test_command_queue_full);
+  RUN_TEST(test_stale_detach);
+  RUN_TEST(test_attach_full);
+  RUN_TEST(test_priorities);
+  RUN_TEST(test_task_detach);
+  RUN_TEST(test_slack_coalescing);
+#if ASYNC_LOOP_TICKLESS
+  RUN_TEST(test_tickless);
+#endif
+  return UNITY_END();
+
+}
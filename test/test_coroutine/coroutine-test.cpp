@@ -0,0 +1,184 @@
+/*
+ * coroutine-test.cpp
+ * Copyright 2020 - Juan C. Bryksa (jcbryksa@gmail.com)
+ *
+ * Pruebas de Coroutine en el host (pio test -e test): con todos los
+ * espacios de AsyncLoop ocupados la corrutina queda demorada y se reanuda
+ * al liberarse uno, sin perder la espera ya transcurrida
+ */
+
+#include <Arduino.h>
+#include <unity.h>
+#include "coroutine.hpp"
+
+#if ASYNC_LOOP_TIMER == 2
+#define TICK_VECTOR TIMER2_COMPA_vect
+#elif ASYNC_LOOP_TIMER == 0
+#define TICK_VECTOR TIMER0_COMPB_vect
+#elif ! ASYNC_LOOP_ABSOLUTE
+#define TICK_VECTOR TIMER1_OVF_vect
+#else
+#error "las pruebas de Coroutine avanzan un tick fijo por interrupcion"
+#endif
+
+extern "C" void TICK_VECTOR(void);
+
+#define DELAY 20
+
+static AsynchLoop::LoopId fillers[MAX_ASYNC_LOOPS];
+static uint8_t filled = 0;
+static uint8_t resumed = 0;
+static unsigned long resumedAt = 0;
+static uint8_t ready = 0;
+
+
+static void tick(void) {
+  TICK_VECTOR();
+  AsyncLoop.dispatch();
+}
+
+
+static void idle(void) {
+}
+
+
+// Ocupa todos los espacios (desde loop() solo SPARE_LOOPS por tick)
+static void fill(void) {
+  while ( AsyncLoop.active() < MAX_ASYNC_LOOPS ) {
+    AsynchLoop::LoopId id = setInterval(idle, 60000);
+    if ( id == INVALID_LOOP )
+      tick();
+    else
+      fillers[filled++] = id;
+  }
+}
+
+
+static void release(void) {
+  clearInterval(fillers[--filled]);
+}
+
+
+static Coroutine::Result delayed(Coroutine *co) {
+  CO_BEGIN(co);
+  CO_DELAY(co, DELAY);
+  resumed++;
+  resumedAt = AsyncLoop.ticks();
+  CO_END(co);
+}
+
+
+static Coroutine::Result awaiting(Coroutine *co) {
+  CO_BEGIN(co);
+  CO_AWAIT(co, ready);
+  resumed++;
+  CO_END(co);
+}
+
+
+// Acceso al estado privado del escaneo de reintentos
+struct CoroutineTest {
+  static uint8_t retrying(void) {
+    return Coroutine::_retrying;
+  }
+};
+
+
+static Coroutine delayedCoroutine(delayed);
+static Coroutine awaitingCoroutine(awaiting, AsynchLoop::HIGH_PRIORITY);
+
+
+void setUp(void) {
+  resumed = 0;
+  ready = 0;
+  fill();
+}
+
+
+void tearDown(void) {
+  while ( filled )
+    release();
+  tick();
+}
+
+
+void test_delay_survives_exhausted_slots(void) {
+
+  unsigned long start = AsyncLoop.ticks();
+
+  delayedCoroutine.start();
+  TEST_ASSERT_TRUE(delayedCoroutine.running());
+  TEST_ASSERT_TRUE(delayedCoroutine.stalled());
+  TEST_ASSERT_TRUE(CoroutineTest::retrying());
+
+  for ( uint8_t i = 0 ; i < DELAY / 2 ; i++ )
+    tick();
+  TEST_ASSERT_TRUE(delayedCoroutine.stalled());
+
+  // Al liberarse un espacio se reprograma con la espera restante
+  release();
+  tick();
+  tick();
+  TEST_ASSERT_FALSE(delayedCoroutine.stalled());
+
+  while ( ! resumed && AsyncLoop.ticks() < start + 2 * DELAY )
+    tick();
+
+  TEST_ASSERT_EQUAL(1, resumed);
+  TEST_ASSERT_EQUAL(start + DELAY, resumedAt);
+  TEST_ASSERT_FALSE(delayedCoroutine.running());
+
+  // Sin demoradas el escaneo de reintentos se quita
+  TEST_ASSERT_FALSE(CoroutineTest::retrying());
+
+}
+
+
+void test_await_survives_exhausted_slots(void) {
+
+  awaitingCoroutine.start();
+  TEST_ASSERT_TRUE(awaitingCoroutine.stalled());
+
+  ready = 1;
+  for ( uint8_t i = 0 ; i < 10 ; i++ )
+    tick();
+  TEST_ASSERT_EQUAL(0, resumed);
+
+  release();
+  for ( uint8_t i = 0 ; i < 3 ; i++ )
+    tick();
+
+  TEST_ASSERT_EQUAL(1, resumed);
+  TEST_ASSERT_FALSE(awaitingCoroutine.running());
+
+}
+
+
+void test_stop_discards_stalled(void) {
+
+  delayedCoroutine.start();
+  TEST_ASSERT_TRUE(delayedCoroutine.stalled());
+
+  delayedCoroutine.stop();
+  TEST_ASSERT_FALSE(delayedCoroutine.stalled());
+
+  release();
+  for ( uint8_t i = 0 ; i < 2 * DELAY ; i++ )
+    tick();
+
+  TEST_ASSERT_EQUAL(0, resumed);
+  TEST_ASSERT_FALSE(delayedCoroutine.running());
+  TEST_ASSERT_FALSE(CoroutineTest::retrying());
+
+}
+
+
+int main(void) {
+
+  UNITY_BEGIN();
+  RUN_TEST(test_delay_survives_exhausted_slots);
+  RUN_TEST(test_await_survives_exhausted_slots);
+  RUN_TEST(test_stop_discards_stalled);
+  return UNITY_END();
+
+}
@@ -0,0 +1,234 @@
+/*
+ * state-machine-test.cpp
+ * Copyright 2020 - Juan C. Bryksa (jcbryksa@gmail.com)
+ *
+ * Pruebas de las maquinas de estados en el host (pio test -e test): cada
+ * tabla de transiciones (Elevator, Display y Light) se recorre despachando
+ * todos los eventos en todos los estados, contra la especificacion escrita
+ * aca de forma independiente (estado siguiente y accion de cada celda; las
+ * celdas no listadas deben ignorarse sin cambiar de estado)
+ */
+
+#include <Arduino.h>
+#include <unity.h>
+#include <stdio.h>
+#include "light.hpp"       // antes que elevator.hpp (define ON y OFF)
+#include "display.hpp"
+#include "elevator.hpp"
+
+// Celda esperada de una tabla
+typedef struct {
+  uint8_t state;
+  uint8_t event;
+  uint8_t next;
+  void (*action)(void);
+} Cell;
+
+
+/*
+ * Acceso a las tablas y maquinas privadas de cada modulo
+ */
+struct TransitionTest {
+
+  /*
+   * Despacha cada evento en cada estado en una maquina nueva sobre la tabla
+   * del modulo. Antes de cada despacho prepare() deja al modulo en un punto
+   * valido para ejecutar la accion (ej. un paso pendiente de la escena)
+   */
+  template <typename Machine, uint8_t STATES, uint8_t EVENTS>
+  static void check(const StateTransition (&table)[STATES][EVENTS], const Cell *cells, uint8_t count, void (*prepare)(void)) {
+
+    char message[32];
+
+    for ( uint8_t state = 0 ; state < STATES ; state++ ) {
+      for ( uint8_t event = 0 ; event < EVENTS ; event++ ) {
+
+        const Cell *expected = NULL;
+        for ( uint8_t i = 0 ; i < count ; i++ )
+          if ( cells[i].state == state && cells[i].event == event )
+            expected = &cells[i];
+
+        snprintf(message, sizeof(message), "estado %u evento %u", state, event);
+
+        const StateTransition *transition = &table[state][event];
+        uint8_t next = pgm_read_byte(&transition->next);
+        void (*action)(void) = (void (*)(void)) pgm_read_ptr(&transition->action);
+
+        TEST_ASSERT_EQUAL_UINT8_MESSAGE(expected ? expected->next : NO_TRANSITION, next, message);
+        TEST_ASSERT_TRUE_MESSAGE(action == (expected ? expected->action : NULL), message);
+
+        Machine machine(state);
+        prepare();
+
+        TEST_ASSERT_EQUAL_UINT8_MESSAGE(expected ? 1 : 0, machine.dispatch(event), message);
+        TEST_ASSERT_EQUAL_UINT8_MESSAGE(expected ? expected->next : state, machine.state(), message);
+      }
+    }
+  }
+
+  static void elevator(void);
+  static void display(void);
+  static void light(void);
+
+  static void elevatorPrepare(void);
+  static void displayPrepare(void);
+  static void lightPrepare(void);
+
+};
+
+
+void TransitionTest::elevatorPrepare(void) {
+  Elevator::_goToFloor = NO_FLOOR;
+}
+
+
+void TransitionTest::elevator(void) {
+
+  const Cell cells[] = {
+    {Elevator::READY,   Elevator::REQUESTED, Elevator::BUSY,    Elevator::_depart},
+    {Elevator::READY,   Elevator::CALLED,    Elevator::WAITING, Elevator::_beep},
+    {Elevator::BUSY,    Elevator::AT_TARGET, Elevator::READY,   Elevator::_arrive},
+    {Elevator::WAITING, Elevator::DEPARTED,  Elevator::READY,   NULL},
+  };
+
+  check<Elevator::Machine>(Elevator::_transitions, cells, sizeof(cells) / sizeof(cells[0]), elevatorPrepare);
+
+}
+
+
+void TransitionTest::displayPrepare(void) {
+  Display::_effectStep = 0;
+  Display::_blinkCounter = 0;
+}
+
+
+void TransitionTest::display(void) {
+
+  // TICK avanza el efecto en curso; SELECT + efecto lo inicia desde cualquier estado
+  Cell cells[Display::EFFECTS + Display::EFFECTS * Display::EFFECTS];
+  uint8_t count = 0;
+
+  void (* const steps[])(void) = {
+    NULL, Display::_blinkStep, Display::_rightRotationStep, Display::_leftRotationStep,
+    Display::_shiftUpStep, Display::_shiftDownStep
+  };
+  void (* const starts[])(void) = {
+    Display::_showValue, Display::_startBlink, Display::_startRightRotation,
+    Display::_startLeftRotation, Display::_startShift, Display::_startShift
+  };
+
+  for ( uint8_t effect = Display::BLINK ; effect < Display::EFFECTS ; effect++ )
+    cells[count++] = {effect, Display::TICK, effect, steps[effect]};
+
+  for ( uint8_t state = 0 ; state < Display::EFFECTS ; state++ )
+    for ( uint8_t effect = 0 ; effect < Display::EFFECTS ; effect++ )
+      cells[count++] = {state, (uint8_t) (Display::SELECT + effect), effect, starts[effect]};
+
+  check<Display::Machine>(Display::_transitions, cells, count, displayPrepare);
+
+}
+
+
+void TransitionTest::lightPrepare(void) {
+  Light::_step = 1;
+}
+
+
+void TransitionTest::light(void) {
+
+  // STEP sigue en la escena, LAST_STEP vuelve a NONE (ambos con el mismo paso)
+  void (* const steps[])(void) = {
+    NULL, Light::_sequentialOnStep, Light::_sequentialOffStep, Light::_fadeOnStep,
+    Light::_fadeOffStep, Light::_sequentialFadeOnStep, Light::_sequentialFadeOffStep
+  };
+
+  Cell cells[2 * Light::SCENES + Light::SCENES * Light::SCENES];
+  uint8_t count = 0;
+
+  for ( uint8_t scene = Light::SEQUENTIAL_ON ; scene < Light::SCENES ; scene++ ) {
+    cells[count++] = {scene, Light::STEP, scene, steps[scene]};
+    cells[count++] = {scene, Light::LAST_STEP, Light::NONE, steps[scene]};
+  }
+
+  // SELECT + escena solo cambia de estado: la escena ya quedo preparada
+  for ( uint8_t state = 0 ; state < Light::SCENES ; state++ )
+    for ( uint8_t scene = 0 ; scene < Light::SCENES ; scene++ )
+      cells[count++] = {state, (uint8_t) (Light::SELECT + scene), scene, NULL};
+
+  check<Light::Machine>(Light::_transitions, cells, count, lightPrepare);
+
+}
+
+
+enum : uint8_t {IDLE, RUNNING, STATES};
+enum : uint8_t {START, STOP, EVENTS};
+
+static uint8_t origin = 0;
+static uint8_t actions = 0;
+
+static void begin(void);
+
+const StateTransition table[STATES][EVENTS] PROGMEM = {
+  //             START              STOP
+  /* IDLE */    {{RUNNING, begin}, IGNORED},
+  /* RUNNING */ {IGNORED,          {IDLE, NULL}},
+};
+
+static StateMachine<STATES, EVENTS, table, ELEVATOR_MACHINE> machine(IDLE);
+
+static void begin(void) {
+  origin = machine.state();
+  actions++;
+}
+
+
+void setUp(void) {
+}
+
+
+void tearDown(void) {
+}
+
+
+// La accion se ejecuta antes del cambio de estado y ve el estado de origen
+void test_action_sees_origin_state(void) {
+
+  TEST_ASSERT_EQUAL(1, machine.dispatch(START));
+  TEST_ASSERT_EQUAL(1, actions);
+  TEST_ASSERT_EQUAL(IDLE, origin);
+  TEST_ASSERT_EQUAL(RUNNING, machine.state());
+
+  TEST_ASSERT_EQUAL(0, machine.dispatch(START));
+  TEST_ASSERT_EQUAL(1, actions);
+
+  TEST_ASSERT_EQUAL(1, machine.dispatch(STOP));
+  TEST_ASSERT_EQUAL(IDLE, machine.state());
+
+}
+
+
+void test_elevator_transitions(void) {
+  TransitionTest::elevator();
+}
+
+
+void test_display_transitions(void) {
+  TransitionTest::display();
+}
+
+
+void test_light_transitions(void) {
+  TransitionTest::light();
+}
+
+
+int main(void) {
+
+  UNITY_BEGIN();
+  RUN_TEST(test_action_sees_origin_state);
+  RUN_TEST(test_elevator_transitions);
+  RUN_TEST(test_display_transitions);
+  RUN_TEST(test_light_transitions);
+  return UNITY_END();
+
+}
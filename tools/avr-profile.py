@@ -0,0 +1,162 @@
+#!/usr/bin/env python3
+"""
+avr-profile.py
+Copyright 2020 - Juan C. Bryksa (jcbryksa@gmail.com)
+
+Perfilado ciclo a ciclo del firmware real en simavr y seguimiento de
+regresiones entre commits.
+
+  pio run -e profile && pio run -e simavr
+  tools/avr-profile.py [--session profile/session.txt] [--ms 16000]
+                       [--baseline profile/baseline.json] [--tolerance 5]
+                       [--update-baseline] [--history archivo.jsonl]
+
+Obtiene con avr-nm las direcciones de las funciones medidas, ejecuta el
+harness (profile/simavr-profile.cpp) y muestra por funcion invocaciones y
+ciclos min/medio/max, y la ventana mas larga con las interrupciones
+deshabilitadas. Con --history agrega el resultado, con el commit actual, a
+ese archivo (fuera del arbol o ignorado por git).
+
+Si existe la referencia aprobada (profile/baseline.json, misma sesion y
+duracion) compara contra ella: termina con 1 si el maximo de alguna
+funcion o la ventana sin interrupciones crecio mas que la tolerancia (la de
+la referencia salvo --tolerance), o si la referencia no tiene el valor
+medido. Sin referencia solo informa la medicion. --update-baseline la crea
+o reemplaza por la medicion actual, en un commit que explica el cambio.
+"""
+
+import argparse
+import json
+import os
+import subprocess
+import sys
+
+FUNCTIONS = [
+    "AsynchLoop::callAsyncLoops()",
+    "Keypad::scan()",
+    "Display::_setSegmentsByte(unsigned char)",
+    "Light::_setZone(unsigned char, int, int, int)",
+    "Light::setAll(int, int, int)",
+    "Elevator::_scan(void*)",
+]
+
+ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+
+
+def symbols(elf):
+    output = subprocess.run(["avr-nm", "-C", elf], check=True, capture_output=True, text=True).stdout
+    table = {}
+    for line in output.splitlines():
+        parts = line.split(None, 2)
+        if len(parts) == 3 and parts[1] in "tT":
+            table[parts[2]] = int(parts[0], 16)
+    return table
+
+
+def source_line(elf, pc):
+    try:
+        output = subprocess.run(["avr-addr2line", "-C", "-f", "-e", elf, hex(pc)],
+                                check=True, capture_output=True, text=True).stdout.split()
+        return " ".join(output)
+    except (OSError, subprocess.CalledProcessError):
+        return hex(pc)
+
+
+def commit():
+    try:
+        head = subprocess.run(["git", "rev-parse", "--short", "HEAD"], cwd=ROOT,
+                              check=True, capture_output=True, text=True).stdout.strip()
+        dirty = subprocess.run(["git", "diff", "--quiet", "HEAD"], cwd=ROOT).returncode
+        return head + ("-dirty" if dirty else "")
+    except (OSError, subprocess.CalledProcessError):
+        return "desconocido"
+
+
+def regressions(baseline, current, tolerance):
+    found = []
+    pairs = [(name, (baseline["functions"].get(name) or {}).get("max"), values["max"])
+             for name, values in current["functions"].items()]
+    pairs.append(("irq_off", (baseline.get("irq_off") or {}).get("max"), current["irq_off"]["max"]))
+    for name, before, now in pairs:
+        if before is None or now > before * (1 + tolerance / 100.0):
+            found.append((name, before, now))
+    return found
+
+
+def write_baseline(path, record, tolerance):
+    baseline = {"commit": record["commit"], "session": record["session"], "ms": record["ms"],
+                "tolerance": tolerance,
+                "functions": {name: {"mean": round(values["mean"], 1), "max": values["max"]}
+                              for name, values in record["functions"].items()},
+                "irq_off": {"max": record["irq_off"]["max"]}}
+    with open(path, "w") as output:
+        json.dump(baseline, output, indent=2)
+        output.write("\n")
+
+
+def main():
+    parser = argparse.ArgumentParser(description="perfilado del firmware en simavr")
+    parser.add_argument("--elf", default=os.path.join(ROOT, ".pio/build/profile/firmware.elf"))
+    parser.add_argument("--harness", default=os.path.join(ROOT, ".pio/build/simavr/program"))
+    parser.add_argument("--session", default=os.path.join(ROOT, "profile/session.txt"))
+    parser.add_argument("--ms", type=int, default=16000, help="tiempo simulado")
+    parser.add_argument("--history", help="agrega el resultado a este archivo (JSON por linea)")
+    parser.add_argument("--baseline", default=os.path.join(ROOT, "profile/baseline.json"))
+    parser.add_argument("--tolerance", type=float, help="crecimiento admitido (%%, por defecto el de la referencia)")
+    parser.add_argument("--update-baseline", action="store_true", help="reemplaza la referencia por esta medicion")
+    args = parser.parse_args()
+
+    table = symbols(args.elf)
+    arguments = []
+    for name in FUNCTIONS:
+        if name not in table:
+            sys.exit("%s: no se encuentra %s (compilar con -e profile)" % (args.elf, name))
+        arguments.append("%s=0x%x" % (name, table[name]))
+
+    result = json.loads(subprocess.run([args.harness, args.elf, args.session, str(args.ms)] + arguments,
+                                       check=True, capture_output=True, text=True).stdout)
+
+    print("%-48s %8s %8s %10s %8s" % ("funcion", "llamadas", "min", "medio", "max"))
+    for name, values in result["functions"].items():
+        print("%-48s %8d %8d %10.1f %8d" % (name, values["calls"], values["min"], values["mean"], values["max"]))
+    print("interrupciones deshabilitadas: max %d ciclos en %s"
+          % (result["irq_off"]["max"], source_line(args.elf, result["irq_off"]["pc"])))
+    if result["lost_frames"]:
+        print("aviso: %d invocaciones sin medir (anidamiento excesivo)" % result["lost_frames"])
+
+    record = {"commit": commit(), "session": os.path.basename(args.session), "ms": args.ms,
+              "functions": result["functions"], "irq_off": result["irq_off"]}
+
+    status = 0
+    baseline = {}
+    if os.path.exists(args.baseline):
+        with open(args.baseline) as source:
+            baseline = json.load(source)
+    tolerance = args.tolerance if args.tolerance is not None else baseline.get("tolerance", 5.0)
+
+    if args.update_baseline:
+        write_baseline(args.baseline, record, tolerance)
+        print("referencia actualizada: %s" % args.baseline)
+    elif not baseline:
+        print("sin referencia (%s): no se compara; --update-baseline la crea" % args.baseline)
+    elif baseline.get("session") != record["session"] or baseline.get("ms") != record["ms"]:
+        print("la referencia es de %s (%s ms): sin comparar" % (baseline.get("session"), baseline.get("ms")))
+        status = 1
+    else:
+        for name, before, now in regressions(baseline, record, tolerance):
+            if before is None:
+                print("SIN REFERENCIA %s: max %d ciclos (--update-baseline)" % (name, now))
+            else:
+                print("REGRESION %s: max %d -> %d ciclos (tolerancia %g%%, referencia %s)"
+                      % (name, before, now, tolerance, baseline["commit"]))
+            status = 1
+
+    if args.history:
+        with open(args.history, "a") as history:
+            history.write(json.dumps(record) + "\n")
+
+    return status
+
+
+if __name__ == "__main__":
+    sys.exit(main())
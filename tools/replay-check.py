@@ -0,0 +1,79 @@
+#!/usr/bin/env python3
+"""
+replay-check.py
+Copyright 2020 - Juan C. Bryksa (jcbryksa@gmail.com)
+
+Compara la reproduccion de cada sesion de referencia (replay/sessions/
+nombre.txt) contra su linea de tiempo aprobada (nombre.expected.txt).
+
+  pio run -e replay
+  tools/replay-check.py [--program .pio/build/replay/program]
+                        [--tolerance ticks] [--update] [sesion.txt ...]
+
+Informa por sesion "ok" o la divergencia que detecta el programa de
+reproduccion, y termina con 1 si alguna difiere. Con --update regenera las
+lineas de tiempo aprobadas: solo para un cambio de comportamiento
+deliberado, que se explica en el mismo commit.
+"""
+
+import argparse
+import glob
+import os
+import subprocess
+import sys
+
+ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+EXPECTED = ".expected.txt"
+
+
+def expected_path(session):
+    return session[:-len(".txt")] + EXPECTED
+
+
+def main():
+    parser = argparse.ArgumentParser(description="reproduccion de las sesiones de referencia")
+    parser.add_argument("sessions", nargs="*", help="por defecto replay/sessions/*.txt")
+    parser.add_argument("--program", default=os.path.join(ROOT, ".pio/build/replay/program"))
+    parser.add_argument("--tolerance", type=int, default=0, help="corrimiento admitido (ticks)")
+    parser.add_argument("--update", action="store_true", help="regenera las lineas de tiempo aprobadas")
+    args = parser.parse_args()
+
+    sessions = args.sessions or sorted(path for path in glob.glob(os.path.join(ROOT, "replay/sessions/*.txt"))
+                                       if not path.endswith(EXPECTED))
+    if not sessions:
+        sys.exit("no hay sesiones de referencia")
+
+    if not os.path.exists(args.program):
+        sys.exit("%s: no existe (compilar con pio run -e replay)" % args.program)
+
+    status = 0
+    for session in sessions:
+        name = os.path.basename(session)
+        expected = expected_path(session)
+
+        if args.update:
+            with open(expected, "w") as output:
+                subprocess.run([args.program, session], check=True, stdout=output)
+            print("%-24s actualizada" % name)
+            continue
+
+        if not os.path.exists(expected):
+            print("%-24s sin %s" % (name, os.path.basename(expected)))
+            status = 1
+            continue
+
+        result = subprocess.run([args.program, session, "--expect", expected, "--tolerance", str(args.tolerance)],
+                                capture_output=True, text=True)
+        if result.returncode == 0:
+            print("%-24s ok" % name)
+        else:
+            print("%-24s DIFIERE" % name)
+            for line in (result.stdout + result.stderr).splitlines():
+                print("  " + line)
+            status = 1
+
+    return status
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,157 @@
+#!/usr/bin/env python3
+"""
+size-budget.py
+Copyright 2020 - Juan C. Bryksa (jcbryksa@gmail.com)
+
+Presupuesto estatico de memoria del firmware: bytes de .data y .bss por
+modulo (clase o variable global), lo que queda libre para la pila y el uso
+de flash (.text + .data, los valores iniciales de .data tambien ocupan flash).
+
+  python3 tools/size-budget.py .pio/build/nanoatmega328/firmware.elf [--symbols]
+                               [--flash-measured bytes] [--ram-measured bytes]
+                               [--margin %]
+
+Termina con 1 si el firmware no cabe en el Nano o, si se registro el tamano
+de una compilacion aprobada (--flash-measured, --ram-measured), si lo supera
+en mas del margen. Sin tamano registrado solo se verifica la capacidad y se
+informa la medicion actual, que es el valor a registrar. Se ejecuta al final
+de cada compilacion del firmware (extra_scripts = post:tools/size-budget.py
+en platformio.ini) con custom_flash_measured, custom_ram_measured y
+custom_budget_margin si estan definidos, por lo que la compilacion falla si
+se superan.
+"""
+
+import argparse
+import os
+import subprocess
+import sys
+
+RAM_SIZE = 2048                     # SRAM del ATmega328P
+FLASH_SIZE = 30720                  # 32 KB menos el bootloader del Nano (2 KB)
+
+# Variables globales sin clase: modulo al que pertenecen
+ALIASES = {
+    "AsyncLoop": "AsynchLoop",
+    "Serial": "HardwareSerial",
+}
+PREFIXES = [
+    ("timer0_", "core (millis)"),
+    ("__", "runtime"),
+]
+
+
+def module(name):
+    if "::" in name:
+        return name.split("::", 1)[0]
+    if name in ALIASES:
+        return ALIASES[name]
+    for prefix, owner in PREFIXES:
+        if name.startswith(prefix):
+            return owner
+    return name
+
+
+def ram_symbols(nm, elf):
+    output = subprocess.run([nm, "-C", "-S", "--size-sort", elf],
+                            check=True, capture_output=True, text=True).stdout
+    symbols = []
+    for line in output.splitlines():
+        parts = line.split(None, 3)
+        if len(parts) == 4 and parts[2] in "bBdD":
+            symbols.append((parts[3], int(parts[1], 16)))
+    return symbols
+
+
+def sections(size, elf):
+    output = subprocess.run([size, "-A", elf], check=True, capture_output=True, text=True).stdout
+    totals = {}
+    for line in output.splitlines():
+        parts = line.split()
+        if len(parts) >= 2 and parts[0] in (".text", ".data", ".bss", ".noinit"):
+            totals[parts[0]] = int(parts[1])
+    return totals
+
+
+def report(nm, size, elf, show_symbols):
+    symbols = ram_symbols(nm, elf)
+    modules = {}
+    for name, bytes_ in symbols:
+        modules.setdefault(module(name), []).append((name, bytes_))
+
+    print("RAM por modulo (%s)" % os.path.basename(elf))
+    for owner, entries in sorted(modules.items(), key=lambda item: -sum(b for _, b in item[1])):
+        print("  %-28s %6d" % (owner, sum(b for _, b in entries)))
+        if show_symbols:
+            for name, bytes_ in sorted(entries, key=lambda entry: -entry[1]):
+                print("      %-40s %6d" % (name, bytes_))
+
+    totals = sections(size, elf)
+    ram = {name: bytes_ for name, bytes_ in totals.items() if name != ".text"}
+    used = sum(ram.values())
+    print("  %-28s %6d  (%s)" % ("total estatico", used,
+                                 ", ".join("%s %d" % item for item in sorted(ram.items()))))
+    print("  %-28s %6d  de %d bytes (%.1f%% usado)" % ("libre para la pila", RAM_SIZE - used,
+                                                      RAM_SIZE, 100.0 * used / RAM_SIZE))
+
+    flash = totals.get(".text", 0) + totals.get(".data", 0)
+    print("Flash %d de %d bytes (%.1f%% usado)" % (flash, FLASH_SIZE, 100.0 * flash / FLASH_SIZE))
+
+    return flash, used
+
+
+def budget(measured, margin, capacity):
+    if not measured:
+        return capacity
+    return min(capacity, int(measured * (1 + margin / 100.0)))
+
+
+def check(flash, ram, flash_measured, ram_measured, margin):
+    exceeded = 0
+    for name, option, used, measured, capacity in (
+            ("flash", "custom_flash_measured", flash, flash_measured, FLASH_SIZE),
+            ("RAM", "custom_ram_measured", ram, ram_measured, RAM_SIZE)):
+        limit = budget(measured, margin, capacity)
+        if not measured:
+            print("%s: sin tamano registrado, solo se verifica la capacidad (%d bytes); para "
+                  "detectar regresiones registrar %s = %d" % (name, capacity, option, used))
+        else:
+            print("Presupuesto %s %d bytes (medido %d + %g%%), usado %d" % (name, limit, measured, margin, used))
+        if used > limit:
+            print("ERROR: %s %d bytes excede el presupuesto de %d bytes" % (name, used, limit))
+            exceeded = 1
+    return exceeded
+
+
+def tool(compiler, name):
+    # avr-gcc -> avr-nm, avr-size
+    return compiler[:-3] + name if compiler.endswith("gcc") else name
+
+
+try:
+    Import("env")                   # ejecutado por PlatformIO (extra_scripts)
+except NameError:
+    env = None
+
+if env is not None:
+    script = os.path.join(env.subst("$PROJECT_DIR"), "tools", "size-budget.py")
+    compiler = env.subst("$CC")
+    env.AddPostAction("$BUILD_DIR/${PROGNAME}.elf", env.VerboseAction(
+        '"$PYTHONEXE" "%s" --nm "%s" --size "%s" --flash-measured %s --ram-measured %s --margin %s '
+        '$BUILD_DIR/${PROGNAME}.elf'
+        % (script, tool(compiler, "nm"), tool(compiler, "size"),
+           env.GetProjectOption("custom_flash_measured", "0"), env.GetProjectOption("custom_ram_measured", "0"),
+           env.GetProjectOption("custom_budget_margin", "10")),
+        "Presupuesto de memoria"))
+
+elif __name__ == "__main__":
+    parser = argparse.ArgumentParser(description="presupuesto estatico de memoria por modulo")
+    parser.add_argument("elf")
+    parser.add_argument("--nm", default="avr-nm")
+    parser.add_argument("--size", default="avr-size")
+    parser.add_argument("--symbols", action="store_true", help="detalla cada variable")
+    parser.add_argument("--flash-measured", type=int, default=0, help=".text + .data aprobado (0: sin registrar)")
+    parser.add_argument("--ram-measured", type=int, default=0, help=".data + .bss aprobado (0: sin registrar)")
+    parser.add_argument("--margin", type=float, default=10.0, help="crecimiento admitido (%%)")
+    args = parser.parse_args()
+    flash, ram = report(args.nm, args.size, args.elf, args.symbols)
+    sys.exit(check(flash, ram, args.flash_measured, args.ram_measured, args.margin))
@@ -0,0 +1,208 @@
+#!/usr/bin/env python3
+"""
+station-cli.py
+Copyright 2020 - Juan C. Bryksa (jcbryksa@gmail.com)
+
+Consola del canal binario de Telemetry (firmware compilado con
+-DTELEMETRY_ENABLED=1): consulta el estado de la estacion y envia comandos.
+
+  python3 tools/station-cli.py --port /dev/ttyUSB0 status
+  python3 tools/station-cli.py --port /dev/ttyUSB0 goto 3
+  python3 tools/station-cli.py --port /dev/ttyUSB0 light on
+  python3 tools/station-cli.py --port /dev/ttyUSB0 scene 2
+  python3 tools/station-cli.py --port /dev/ttyUSB0 watch
+  python3 tools/station-cli.py --port /dev/ttyUSB0           (modo interactivo)
+
+Sin la placa se puede usar el firmware del host (requiere pyserial):
+
+  pio run -e replay   (agregar -DTELEMETRY_ENABLED=1 a build_flags)
+  .pio/build/replay/program sesion.txt --serial   -> "Serial en /dev/pts/N"
+  python3 tools/station-cli.py --port /dev/pts/N status
+"""
+
+import argparse
+import shlex
+import sys
+import time
+
+SYNC = 0xA5
+MAX_PAYLOAD = 12
+
+# Mismos valores que Telemetry::Type (include/telemetry.hpp)
+STATUS_REQUEST = 0x01
+GO_TO = 0x02
+SET_LIGHT = 0x03
+SET_SCENE = 0x04
+STATUS = 0x81
+ACK = 0x82
+NACK = 0x83
+
+COMMANDS = {GO_TO: "goto", SET_LIGHT: "light", SET_SCENE: "scene", STATUS_REQUEST: "status"}
+REASONS = {1: "tipo desconocido", 2: "largo invalido", 3: "rechazado por la estacion"}
+ELEVATOR = ["READY", "BUSY", "WAITING", "ERROR"]
+LIGHT_STATUS = ["ON", "OFF"]
+SCENES = ["NONE", "SEQUENTIAL_ON", "SEQUENTIAL_OFF", "FADE_ON", "FADE_OFF",
+          "SEQUENTIAL_FADE_ON", "SEQUENTIAL_FADE_OFF"]
+NO_FLOOR = 255
+
+
+def crc8(data):
+    """CRC-8 de avr-libc (_crc8_ccitt_update, polinomio 0x07)"""
+    crc = 0
+    for byte in data:
+        crc ^= byte
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x07) & 0xFF if crc & 0x80 else (crc << 1) & 0xFF
+    return crc
+
+
+def frame(frame_type, payload=b""):
+    body = bytes([len(payload), frame_type]) + bytes(payload)
+    return bytes([SYNC]) + body + bytes([crc8(body)])
+
+
+class Channel:
+    """Extrae tramas validas del flujo de bytes (el resto se ignora, ej.
+    las lineas del registro de entradas)"""
+
+    def __init__(self, device):
+        self.device = device
+        self.buffer = bytearray()
+
+    def send(self, frame_type, payload=b""):
+        self.device.write(frame(frame_type, payload))
+
+    def receive(self, timeout=1.0):
+        deadline = time.monotonic() + timeout
+        while True:
+            parsed = self._parse()
+            if parsed:
+                return parsed
+            if time.monotonic() > deadline:
+                return None
+            self.buffer += self.device.read(self.device.in_waiting or 1)
+
+    def _parse(self):
+        while True:
+            start = self.buffer.find(SYNC)
+            if start < 0:
+                self.buffer.clear()
+                return None
+            del self.buffer[:start]
+            if len(self.buffer) < 2:
+                return None
+            length = self.buffer[1]
+            if length > MAX_PAYLOAD:
+                del self.buffer[0]
+                continue
+            if len(self.buffer) < length + 4:
+                return None
+            body = bytes(self.buffer[1:length + 3])
+            if crc8(body) != self.buffer[length + 3]:
+                del self.buffer[0]
+                continue
+            del self.buffer[:length + 4]
+            return body[1], body[2:]
+
+    def request(self, frame_type, payload=b""):
+        self.send(frame_type, payload)
+        reply = self.receive()
+        if reply is None:
+            raise RuntimeError("sin respuesta")
+        return reply
+
+
+def floor_name(floor):
+    return "entre pisos" if floor == NO_FLOOR else str(floor + 1)
+
+
+def boot_time(millis):
+    return "%d ms" % millis if millis else "(aun no listo)"
+
+
+def describe_status(payload):
+    if len(payload) < 12:
+        return "estado incompleto: %s" % bytes(payload).hex()
+    names = lambda table, value: table[value] if value < len(table) else str(value)
+    return ("ascensor %s piso %s | luces %s escena %s combinacion %d | "
+            "loops %d/%d | eventos descartados %d | tramas con error %d | respuestas descartadas %d | "
+            "arranque %s" % (
+                names(ELEVATOR, payload[0]), floor_name(payload[1]),
+                names(LIGHT_STATUS, payload[2]), names(SCENES, payload[3]), payload[4],
+                payload[5], payload[6], payload[7], payload[8], payload[9],
+                boot_time(payload[10] | payload[11] << 8)))
+
+
+def describe(reply):
+    frame_type, payload = reply
+    if frame_type == STATUS:
+        return describe_status(payload)
+    if frame_type == ACK:
+        return "ok (%s)" % COMMANDS.get(payload[0], payload[0])
+    if frame_type == NACK:
+        return "error (%s): %s" % (COMMANDS.get(payload[0], payload[0]),
+                                   REASONS.get(payload[1], payload[1]))
+    return "trama 0x%02x: %s" % (frame_type, bytes(payload).hex())
+
+
+def execute(channel, words):
+    command = words[0]
+
+    if command == "status":
+        return describe(channel.request(STATUS_REQUEST))
+    if command == "goto" and len(words) == 2:
+        return describe(channel.request(GO_TO, [int(words[1]) - 1]))
+    if command == "light" and len(words) == 2 and words[1] in ("on", "off"):
+        return describe(channel.request(SET_LIGHT, [1 if words[1] == "on" else 0]))
+    if command == "scene" and len(words) == 2:
+        return describe(channel.request(SET_SCENE, [int(words[1])]))
+    if command == "watch":
+        interval = float(words[1]) if len(words) > 1 else 0.5
+        while True:
+            print(describe(channel.request(STATUS_REQUEST)), flush=True)
+            time.sleep(interval)
+
+    raise ValueError("comandos: status | goto <1-3> | light on|off | scene <n> | watch [segundos]")
+
+
+def interactive(channel):
+    while True:
+        try:
+            line = input("estacion> ")
+        except EOFError:
+            return
+        words = shlex.split(line)
+        if not words:
+            continue
+        if words[0] in ("quit", "exit"):
+            return
+        try:
+            print(execute(channel, words))
+        except (ValueError, RuntimeError) as error:
+            print(error)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n\n")[1])
+    parser.add_argument("--port", required=True, help="puerto serie de la placa o pty del host")
+    parser.add_argument("--baud", type=int, default=115200)
+    parser.add_argument("command", nargs="*", help="status | goto <1-3> | light on|off | scene <n> | watch")
+    options = parser.parse_args()
+
+    import serial  # pyserial
+
+    with serial.Serial(options.port, options.baud, timeout=0.1) as device:
+        channel = Channel(device)
+        if not options.command:
+            interactive(channel)
+            return
+        try:
+            print(execute(channel, options.command))
+        except (ValueError, RuntimeError) as error:
+            sys.exit(error)
+        except KeyboardInterrupt:
+            pass
+
+
+if __name__ == "__main__":
+    main()
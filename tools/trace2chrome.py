@@ -0,0 +1,229 @@
+#!/usr/bin/env python3
+"""
+trace2chrome.py
+Copyright 2020 - Juan C. Bryksa (jcbryksa@gmail.com)
+
+Convierte el volcado de Trace::dump() (firmware compilado con
+-DTRACE_ENABLED=1 o 2) al formato JSON de Chrome trace / Perfetto
+(chrome://tracing o https://ui.perfetto.dev).
+
+  python3 tools/trace2chrome.py volcado.txt > trace.json
+  python3 tools/trace2chrome.py --port /dev/ttyUSB0 > trace.json   (requiere pyserial)
+
+Con --port envia 't' y lee el volcado directamente. Se pueden concatenar
+varios volcados en el mismo archivo: los timestamps (micros()) son continuos.
+"""
+
+import argparse
+import json
+import sys
+
+# Mismo orden que Trace::Event (include/trace.hpp)
+EVENTS = [
+    "KEY_RELEASED",
+    "GO_TO",
+    "READY",
+    "MOTOR_START",
+    "LIMIT_SWITCH",
+    "BRAKE",
+    "STOP",
+    "DISPLAY_EFFECT",
+    "LIGHT_FRAME",
+    "LIGHT_FRAME_END",
+    "TICK_BEGIN",
+    "TICK_END",
+    "TRANSITION",
+]
+
+DIRECTIONS = {0: "none", 1: "up", 2: "down"}
+EFFECTS = ["NONE", "BLINK", "RIGHT_ROTATION", "LEFT_ROTATION", "SHIFT_UP", "SHIFT_DOWN"]
+SCENES = ["NONE", "SEQUENTIAL_ON", "SEQUENTIAL_OFF", "FADE_ON", "FADE_OFF",
+          "SEQUENTIAL_FADE_ON", "SEQUENTIAL_FADE_OFF"]
+NO_FLOOR = 255
+
+# Mismo orden que MachineId (include/state-machine.hpp): hilo y nombres de estados
+MACHINES = [("elevator", ["READY", "BUSY", "WAITING", "ERROR"]),
+            ("display", EFFECTS),
+            ("light", SCENES)]
+
+# Un "hilo" del timeline por modulo
+THREADS = {"keypad": 1, "elevator": 2, "motor": 3, "display": 4, "light": 5, "isr": 6}
+
+
+def read_records(lines):
+    """Devuelve (micros, evento, argumento) de todos los volcados, con el
+    desborde de micros() (cada ~71 minutos) corregido"""
+    records = []
+    offset = 0
+    last = None
+    lost = 0
+
+    for line in lines:
+        fields = line.split()
+        if not fields or fields[0] == "end":
+            continue
+        if fields[0] == "trace":
+            lost += int(fields[2]) if len(fields) > 2 else 0
+            continue
+        if len(fields) != 3 or not all(f.isdigit() for f in fields):
+            continue  # otras salidas por Serial (ej. tabla de perfilado)
+
+        time, event, arg = (int(f) for f in fields)
+        if last is not None and time + offset < last:
+            offset += 1 << 32
+        last = time + offset
+        records.append((last, event, arg))
+
+    return records, lost
+
+
+def name(event):
+    return EVENTS[event] if event < len(EVENTS) else "EVENT_%d" % event
+
+
+def convert(records, lost):
+    events = []
+
+    def instant(ts, tid, label, args=None):
+        events.append({"name": label, "ph": "i", "s": "t", "ts": ts, "pid": 1,
+                       "tid": THREADS[tid], "args": args or {}})
+
+    def span(begin, end, tid, label, args=None):
+        events.append({"name": label, "ph": "X", "ts": begin, "dur": max(end - begin, 1),
+                       "pid": 1, "tid": THREADS[tid], "args": args or {}})
+
+    trip = None        # (inicio, piso) del recorrido en curso
+    motor = None       # (inicio, sentido)
+    brake = None
+    effect = None      # (inicio, efecto)
+    frame = None       # (inicio, escena)
+    ticks = []         # pila de ISR anidados
+    machine_states = {}  # ultimo estado de cada StateMachine
+
+    for ts, event, arg in records:
+        label = name(event)
+
+        if label == "KEY_RELEASED":
+            instant(ts, "keypad", "key %d" % arg)
+
+        elif label == "GO_TO":
+            trip = (ts, arg)
+            instant(ts, "elevator", "goTo %d" % arg)
+
+        elif label == "READY":
+            instant(ts, "elevator", "ready (floor %s)" % floor_name(arg))
+
+        elif label == "MOTOR_START":
+            if motor:
+                span(motor[0], ts, "motor", "motor %s" % DIRECTIONS.get(motor[1], motor[1]))
+            motor = (ts, arg)
+
+        elif label == "LIMIT_SWITCH":
+            instant(ts, "elevator", "switch %s" % floor_name(arg))
+
+        elif label == "BRAKE":
+            if motor:
+                span(motor[0], ts, "motor", "motor %s" % DIRECTIONS.get(motor[1], motor[1]))
+                motor = None
+            brake = ts
+
+        elif label == "STOP":
+            # El frenado invierte el motor: ese tramo queda incluido en "brake"
+            if brake is not None:
+                span(brake, ts, "motor", "brake")
+                brake = None
+            elif motor:
+                span(motor[0], ts, "motor", "motor %s" % DIRECTIONS.get(motor[1], motor[1]))
+            motor = None
+            if trip:
+                span(trip[0], ts, "elevator", "trip to %d" % trip[1],
+                     {"latency_ms": (ts - trip[0]) / 1000.0, "floor": floor_name(arg)})
+                trip = None
+            instant(ts, "elevator", "stop (floor %s)" % floor_name(arg))
+
+        elif label == "DISPLAY_EFFECT":
+            if effect and EFFECTS[effect[1]] != "NONE":
+                span(effect[0], ts, "display", EFFECTS[effect[1]])
+            effect = (ts, min(arg, len(EFFECTS) - 1))
+
+        elif label == "LIGHT_FRAME":
+            frame = (ts, arg)
+
+        elif label == "LIGHT_FRAME_END":
+            if frame:
+                span(frame[0], ts, "light", "frame " + SCENES[min(frame[1], len(SCENES) - 1)])
+                frame = None
+
+        elif label == "TICK_BEGIN":
+            ticks.append(ts)
+
+        elif label == "TICK_END":
+            if ticks:
+                span(ticks.pop(), ts, "isr", "tick" if not ticks else "nested tick")
+
+        elif label == "TRANSITION":
+            machine, state = arg >> 4, arg & 0x0F
+            if machine < len(MACHINES):
+                tid, states = MACHINES[machine]
+                name = states[state] if state < len(states) else str(state)
+                # Las que permanecen en el estado (ej. cada paso de una escena) no lo cambian
+                instant(ts, tid, ("stay " if machine_states.get(machine) == state else "state ") + name)
+                machine_states[machine] = state
+
+        else:
+            instant(ts, "elevator", label, {"arg": arg})
+
+    for tid, number in THREADS.items():
+        events.append({"name": "thread_name", "ph": "M", "pid": 1, "tid": number,
+                       "args": {"name": tid}})
+    events.append({"name": "process_name", "ph": "M", "pid": 1, "args": {"name": "estacion"}})
+
+    return {"traceEvents": events, "displayTimeUnit": "ms",
+            "otherData": {"lost_records": lost}}
+
+
+def floor_name(floor):
+    return "none" if floor == NO_FLOOR else str(floor)
+
+
+def read_port(port, baud):
+    import serial  # pyserial
+
+    with serial.Serial(port, baud, timeout=2) as device:
+        device.write(b"t")
+        lines = []
+        while True:
+            line = device.readline().decode("ascii", "replace")
+            if not line:
+                break
+            lines.append(line)
+            if line.strip() == "end":
+                break
+        return lines
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n\n")[1])
+    parser.add_argument("dump", nargs="?", help="archivo con el volcado (por defecto stdin)")
+    parser.add_argument("--port", help="puerto serie del Arduino")
+    parser.add_argument("--baud", type=int, default=115200)
+    options = parser.parse_args()
+
+    if options.port:
+        lines = read_port(options.port, options.baud)
+    elif options.dump:
+        with open(options.dump) as dump:
+            lines = dump.readlines()
+    else:
+        lines = sys.stdin.readlines()
+
+    records, lost = read_records(lines)
+    if lost:
+        print("aviso: %d registros perdidos (buffer lleno o volcado en curso)" % lost, file=sys.stderr)
+
+    json.dump(convert(records, lost), sys.stdout, indent=1)
+    sys.stdout.write("\n")
+
+
+if __name__ == "__main__":
+    main()